@@ -0,0 +1,306 @@
+// Micro-benchmarks of the spatial and kernel primitives, each on the same
+// fixed-seed inputs, reporting cycles and nanoseconds per call, throughput
+// and the largest difference from the scalar version. Build in Release and
+// run with an optional substring to pick primitives, e.g.
+//   ./fluid-microbench kernel
+
+#include "Simulation.h"
+#include "UniformGrid.h"
+#include "SpatialHashGrid.h"
+#include "KernelVariants.h"
+#include "WaterDrop.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const int batchSize = 4096;
+const float width = 18;
+const float height = 12;
+const float kernelRadius = 0.9f;
+
+// Keeps results alive so the compiler cannot drop the work
+volatile float sink;
+
+struct Timing {
+    double cycles;  // per call, 0 without a time stamp counter
+    double nanoseconds;
+};
+
+// Runs batch() (batchSize calls) until about 50 ms have passed
+template <typename Batch>
+Timing measure(Batch batch) {
+    batch();  // warm up caches and tables
+
+    long calls = 0;
+    auto start = chrono::high_resolution_clock::now();
+#ifdef HAVE_TSC
+    unsigned long long startCycles = __rdtsc();
+#endif
+    double elapsed = 0;
+    do {
+        for (int i = 0; i < 16; i++) {
+            batch();
+        }
+        calls += 16L * batchSize;
+        elapsed = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+    } while (elapsed < 50e6);
+
+    Timing timing;
+    timing.nanoseconds = elapsed / calls;
+#ifdef HAVE_TSC
+    timing.cycles = (double)(__rdtsc() - startCycles) / calls;
+#else
+    timing.cycles = 0;
+#endif
+    return timing;
+}
+
+class Report {
+public:
+    explicit Report(const string &filter) : filter(filter) {
+        cout << left << setw(28) << "primitive" << setw(12) << "variant" << setw(14) << "cycles/call"
+             << setw(12) << "ns/call" << setw(12) << "Mcalls/s" << "max error" << endl;
+    }
+
+    bool wanted(const string &primitive) const {
+        return filter.empty() || primitive.find(filter) != string::npos;
+    }
+
+    void row(const string &primitive, const string &variant, Timing timing, double maxError = 0) {
+        cout << left << setw(28) << primitive << setw(12) << variant << fixed << setprecision(2) << setw(14);
+        if (timing.cycles > 0) cout << timing.cycles;
+        else cout << "-";
+        cout << setw(12) << timing.nanoseconds << setw(12) << 1e3 / timing.nanoseconds
+             << scientific << setprecision(1) << maxError << endl;
+    }
+
+private:
+    string filter;
+};
+
+double maxDifference(const vector<float> &a, const vector<float> &b) {
+    double worst = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        worst = std::max(worst, (double)fabs(a[i] - b[i]));
+    }
+    return worst;
+}
+
+void benchmarkGrids(Report &report, const vector<vec3> &positions) {
+    UniformGrid uniform(width, height);
+    SpatialHashGrid hash;
+    SpatialGrid *grids[] = { &uniform, &hash };
+
+    for (SpatialGrid *grid : grids) {
+        grid->setCellSize(kernelRadius);
+        grid->build(positions);
+    }
+
+    if (report.wanted("bucketOf")) {
+        for (SpatialGrid *grid : grids) {
+            report.row("bucketOf", grid->name(), measure([&] {
+                int sum = 0;
+                for (const vec3 &p : positions) sum += grid->bucketOf(p.x, p.y);
+                sink = (float)sum;
+            }));
+        }
+    }
+    if (report.wanted("neighborBuckets")) {
+        for (SpatialGrid *grid : grids) {
+            report.row("neighborBuckets", grid->name(), measure([&] {
+                int out[9];
+                int sum = 0;
+                for (const vec3 &p : positions) sum += grid->neighborBuckets(p.x, p.y, out) + out[0];
+                sink = (float)sum;
+            }));
+        }
+    }
+}
+
+// Scalar, batch, SIMD and tabulated variants of one distance kernel
+template <typename Scalar, typename Batch, typename Simd, typename Tabulated>
+void benchmarkKernel(Report &report, const string &primitive, const vector<float> &distances,
+                     Scalar scalar, Batch batch, Simd simd, Tabulated tabulated) {
+    if (!report.wanted(primitive)) return;
+
+    vector<float> expected(batchSize), out(batchSize);
+    for (int i = 0; i < batchSize; i++) expected[i] = scalar(distances[i]);
+
+    report.row(primitive, "scalar", measure([&] {
+        for (int i = 0; i < batchSize; i++) out[i] = scalar(distances[i]);
+        sink = out[batchSize - 1];
+    }));
+    batch(distances.data(), out.data(), batchSize);
+    double batchError = maxDifference(expected, out);
+    report.row(primitive, "batch", measure([&] {
+        batch(distances.data(), out.data(), batchSize);
+        sink = out[batchSize - 1];
+    }), batchError);
+    simd(distances.data(), out.data(), batchSize);
+    double simdError = maxDifference(expected, out);
+    report.row(primitive, "simd", measure([&] {
+        simd(distances.data(), out.data(), batchSize);
+        sink = out[batchSize - 1];
+    }), simdError);
+    for (int i = 0; i < batchSize; i++) out[i] = tabulated(distances[i]);
+    double tableError = maxDifference(expected, out);
+    report.row(primitive, "tabulated", measure([&] {
+        for (int i = 0; i < batchSize; i++) out[i] = tabulated(distances[i]);
+        sink = out[batchSize - 1];
+    }), tableError);
+}
+
+void benchmarkPressure(Report &report, const vector<float> &densities) {
+    if (!report.wanted("densityToPressure")) return;
+
+    Simulation sim(1);
+    vector<float> expected(batchSize), out(batchSize);
+    for (int i = 0; i < batchSize; i++) expected[i] = sim.densityToPressure(densities[i]);
+
+    report.row("densityToPressure", "scalar", measure([&] {
+        for (int i = 0; i < batchSize; i++) out[i] = sim.densityToPressure(densities[i]);
+        sink = out[batchSize - 1];
+    }));
+    densityToPressureBatch(sim.targetDensity, sim.pressureMultiplier, densities.data(), out.data(), batchSize);
+    double batchError = maxDifference(expected, out);
+    report.row("densityToPressure", "batch", measure([&] {
+        densityToPressureBatch(sim.targetDensity, sim.pressureMultiplier, densities.data(), out.data(), batchSize);
+        sink = out[batchSize - 1];
+    }), batchError);
+    densityToPressureSimd(sim.targetDensity, sim.pressureMultiplier, densities.data(), out.data(), batchSize);
+    double simdError = maxDifference(expected, out);
+    report.row("densityToPressure", "simd", measure([&] {
+        densityToPressureSimd(sim.targetDensity, sim.pressureMultiplier, densities.data(), out.data(), batchSize);
+        sink = out[batchSize - 1];
+    }), simdError);
+}
+
+void benchmarkBoundaries(Report &report, const vector<WaterDrop> &drops) {
+    if (!report.wanted("ResolveOutOfBounds")) return;
+
+    // Every call needs fresh out-of-bounds drops, so time the copy on its
+    // own and take it off
+    vector<WaterDrop> work(drops);
+    Timing copy = measure([&] {
+        memcpy(work.data(), drops.data(), drops.size() * sizeof(WaterDrop));
+        sink = work[batchSize - 1].position.x;
+    });
+
+    // The simulation's wall pass: gather the fields, reflect, scatter back
+    vector<float> x(batchSize), y(batchSize), velocityX(batchSize), velocityY(batchSize), radius(batchSize);
+    auto reflectGathered = [&](bool simd) {
+        for (int i = 0; i < batchSize; i++) {
+            x[i] = work[i].position.x;
+            y[i] = work[i].position.y;
+            velocityX[i] = work[i].velocity.x;
+            velocityY[i] = work[i].velocity.y;
+            radius[i] = work[i].radius;
+        }
+        auto reflect = simd ? reflectAxisSimd : reflectAxisBatch;
+        reflect(y.data(), velocityY.data(), velocityX.data(), radius.data(), height / 2, 0.5f, batchSize);
+        reflect(x.data(), velocityX.data(), velocityY.data(), radius.data(), width / 2, 0.5f, batchSize);
+        for (int i = 0; i < batchSize; i++) {
+            work[i].position.x = x[i];
+            work[i].position.y = y[i];
+            work[i].velocity.x = velocityX[i];
+            work[i].velocity.y = velocityY[i];
+        }
+    };
+
+    vector<WaterDrop> expected(drops);
+    for (WaterDrop &drop : expected) drop.ResolveOutOfBounds(width, height, 0.5f);
+    auto maxError = [&](bool simd) {
+        work = drops;
+        reflectGathered(simd);
+        double error = 0;
+        for (int i = 0; i < batchSize; i++) {
+            error = std::max(error, (double)length(work[i].position - expected[i].position));
+            error = std::max(error, (double)length(work[i].velocity - expected[i].velocity));
+        }
+        return error;
+    };
+    double batchError = maxError(false);
+    double simdError = maxError(true);
+
+    auto timeVariant = [&](int variant) {
+        Timing timing = measure([&] {
+            memcpy(work.data(), drops.data(), drops.size() * sizeof(WaterDrop));
+            if (variant == 0) {
+                for (WaterDrop &drop : work) drop.ResolveOutOfBounds(width, height, 0.5f);
+            } else {
+                reflectGathered(variant == 2);
+            }
+            sink = work[batchSize - 1].position.x;
+        });
+        timing.cycles -= copy.cycles;
+        timing.nanoseconds -= copy.nanoseconds;
+        return timing;
+    };
+    report.row("ResolveOutOfBounds", "scalar", timeVariant(0));
+    report.row("ResolveOutOfBounds", "batch", timeVariant(1), batchError);
+    report.row("ResolveOutOfBounds", "simd", timeVariant(2), simdError);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+#ifndef __OPTIMIZE__
+    cout << "Warning: built without optimizations, numbers are not representative" << endl;
+#endif
+    Report report(argc > 1 ? argv[1] : "");
+
+    // Inputs shaped like a running scene: positions over the box, distances
+    // mostly inside the kernel radius, densities around the target and a
+    // third of the drops past a wall
+    mt19937 gen(42);
+    uniform_real_distribution<float> xDistrib(-width / 2, width / 2);
+    uniform_real_distribution<float> yDistrib(-height / 2, height / 2);
+    uniform_real_distribution<float> distanceDistrib(0, kernelRadius * 1.3f);
+    uniform_real_distribution<float> densityDistrib(-1, 9);
+    uniform_real_distribution<float> velocityDistrib(-5, 5);
+
+    vector<vec3> positions(batchSize);
+    vector<float> distances(batchSize), densities(batchSize);
+    vector<WaterDrop> drops;
+    for (int i = 0; i < batchSize; i++) {
+        positions[i] = vec3(xDistrib(gen), yDistrib(gen), 0);
+        distances[i] = distanceDistrib(gen);
+        densities[i] = densityDistrib(gen);
+        drops.push_back(WaterDrop(xDistrib(gen) * 1.3f, yDistrib(gen) * 1.3f, 0, 0.1f));
+        drops.back().velocity = vec3(velocityDistrib(gen), velocityDistrib(gen), 0);
+    }
+
+    benchmarkGrids(report, positions);
+
+    KernelTable table(kernelRadius);
+    benchmarkKernel(report, "smoothingKernel", distances,
+        [](float d) { return Simulation::smoothingKernel(kernelRadius, d); },
+        [](const float *d, float *out, int n) { smoothingKernelBatch(kernelRadius, d, out, n); },
+        [](const float *d, float *out, int n) { smoothingKernelSimd(kernelRadius, d, out, n); },
+        [&](float d) { return table.kernel(d); });
+    benchmarkKernel(report, "smoothingKernelDerivative", distances,
+        [](float d) { return Simulation::smoothingKernelDerivative(kernelRadius, d); },
+        [](const float *d, float *out, int n) { smoothingKernelDerivativeBatch(kernelRadius, d, out, n); },
+        [](const float *d, float *out, int n) { smoothingKernelDerivativeSimd(kernelRadius, d, out, n); },
+        [&](float d) { return table.derivative(d); });
+
+    benchmarkPressure(report, densities);
+    benchmarkBoundaries(report, drops);
+    return 0;
+}
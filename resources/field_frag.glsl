@@ -0,0 +1,28 @@
+#version 330 core 
+in vec2 texCoord;
+out vec4 color;
+
+// Channel value in r and the rasterizer's weight in g
+uniform sampler2D field;
+uniform float fieldOffset;
+uniform float fieldScale;
+
+void main()
+{
+	vec2 texel = texture(field, texCoord).rg;
+	float value = (texel.r - fieldOffset) * fieldScale;
+
+	// Same ramp as the drops: red above the offset, blue below
+	vec3 ramp;
+	if (value > 0) {
+		float x = 1 / (1 + value);
+		ramp = vec3(1, x, x);
+	} else {
+		float x = 1 / (1 - value);
+		ramp = vec3(x, x, 1);
+	}
+
+	// Fade into the background where no drops reach
+	float coverage = clamp(texel.g, 0.0, 1.0);
+	color = vec4(mix(vec3(0.2), ramp, coverage), 1.0);
+}
@@ -0,0 +1,15 @@
+#version  330 core
+layout(location = 0) in vec4 vertPos;
+layout(std140) uniform Camera {
+	mat4 P;
+	mat4 V;
+};
+uniform mat4 M;
+out vec2 texCoord;
+
+// The quad spans [0, 1] and M stretches it over the grid
+void main()
+{
+	gl_Position = P * V * M * vertPos;
+	texCoord = vertPos.xy;
+}
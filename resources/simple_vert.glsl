@@ -1,8 +1,10 @@
 #version  330 core
 layout(location = 0) in vec4 vertPos;
 layout(location = 1) in vec3 vertNor;
-uniform mat4 P;
-uniform mat4 V;
+layout(std140) uniform Camera {
+	mat4 P;
+	mat4 V;
+};
 uniform mat4 M;
 uniform float densityDifference;
 out vec3 fragNor;
@@ -0,0 +1,51 @@
+#include "AllocationCheck.h"
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+int runAllocationCheck(int numWaterDrops, int steps, long budget) {
+    bool counting = allocationCountingEnabled();
+    if (!counting) {
+        cerr << "Allocation counting is not compiled in (cmake -DFLUID_COUNT_ALLOCATIONS=ON),"
+             << " checking the step's own buffers only" << endl;
+    }
+
+    Simulation sim;
+    warmUpSimulation(sim, numWaterDrops);
+
+    long worst = 0;
+    int worstStep = -1;
+    int overBudget = 0;
+    Simulation::PhaseStats phaseTotals[Simulation::NumPhases];
+    for (int i = 0; i < steps; i++) {
+        sim.step(benchmarkDeltaTime);
+        long allocations = counting ? sim.getStepStats().heap.allocations : sim.stepAllocations().allocations;
+        if (allocations > worst) {
+            worst = allocations;
+            worstStep = i;
+        }
+        overBudget += allocations > budget;
+        for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+            phaseTotals[phase].ms += sim.getPhaseStats(phase).ms;
+            phaseTotals[phase].heap = phaseTotals[phase].heap + sim.getPhaseStats(phase).heap;
+        }
+    }
+
+    cout << "phase,ms_per_step,allocations,bytes" << endl;
+    for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+        cout << Simulation::phaseName(phase) << "," << fixed << setprecision(3) << phaseTotals[phase].ms / steps
+             << "," << phaseTotals[phase].heap.allocations << "," << phaseTotals[phase].heap.bytes << endl;
+    }
+
+    if (overBudget > 0) {
+        cerr << overBudget << " of " << steps << " warm steps went over the budget of " << budget
+             << " allocations, worst " << worst << " at step " << worstStep << endl;
+        return 1;
+    }
+    cout << "All " << steps << " warm steps within the budget of " << budget << " allocations" << endl;
+    return 0;
+}
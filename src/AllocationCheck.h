@@ -0,0 +1,10 @@
+#ifndef ALLOCATIONCHECK_H
+#define ALLOCATIONCHECK_H
+
+// Warms a simulation of numWaterDrops up, then runs it for steps more and
+// fails (returns 1) if any of those steps made more than budget heap
+// allocations. Counts every operator new in builds with COUNT_ALLOCATIONS,
+// otherwise only the step's own buffers (Simulation::stepAllocations()).
+int runAllocationCheck(int numWaterDrops, int steps = 300, long budget = 0);
+
+#endif // ALLOCATIONCHECK_H
@@ -0,0 +1,72 @@
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<long> allocations(0);
+std::atomic<long> frees(0);
+std::atomic<size_t> bytes(0);
+
+void *countedAllocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    void *memory = malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void countedFree(void *memory) {
+    if (!memory) return;
+    frees.fetch_add(1, std::memory_order_relaxed);
+    free(memory);
+}
+
+} // namespace
+
+// Over-aligned new (C++17) is left alone; nothing here asks for it
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void *memory) noexcept { countedFree(memory); }
+void operator delete[](void *memory) noexcept { countedFree(memory); }
+void operator delete(void *memory, size_t) noexcept { countedFree(memory); }
+void operator delete[](void *memory, size_t) noexcept { countedFree(memory); }
+void operator delete(void *memory, const std::nothrow_t &) noexcept { countedFree(memory); }
+void operator delete[](void *memory, const std::nothrow_t &) noexcept { countedFree(memory); }
+
+bool allocationCountingEnabled() {
+    return true;
+}
+
+AllocationCount allocationCount() {
+    AllocationCount count;
+    count.allocations = allocations.load(std::memory_order_relaxed);
+    count.frees = frees.load(std::memory_order_relaxed);
+    count.bytes = bytes.load(std::memory_order_relaxed);
+    return count;
+}
+
+#else
+
+bool allocationCountingEnabled() {
+    return false;
+}
+
+AllocationCount allocationCount() {
+    return AllocationCount();
+}
+
+#endif
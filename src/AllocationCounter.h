@@ -0,0 +1,36 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+
+// Calls to the global operator new and delete from every thread, and the
+// bytes asked for. Only collected in builds with COUNT_ALLOCATIONS defined
+// (cmake -DFLUID_COUNT_ALLOCATIONS=ON), which replace the global operators;
+// otherwise the counts stay zero.
+struct AllocationCount {
+    long allocations = 0;
+    long frees = 0;
+    size_t bytes = 0;
+
+    AllocationCount operator+(const AllocationCount &other) const {
+        AllocationCount sum = *this;
+        sum.allocations += other.allocations;
+        sum.frees += other.frees;
+        sum.bytes += other.bytes;
+        return sum;
+    }
+    AllocationCount operator-(const AllocationCount &other) const {
+        AllocationCount difference = *this;
+        difference.allocations -= other.allocations;
+        difference.frees -= other.frees;
+        difference.bytes -= other.bytes;
+        return difference;
+    }
+};
+
+bool allocationCountingEnabled();
+
+// Totals since the program started
+AllocationCount allocationCount();
+
+#endif // ALLOCATIONCOUNTER_H
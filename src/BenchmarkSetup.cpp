@@ -0,0 +1,20 @@
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void warmUpSimulation(Simulation &sim, int numWaterDrops, int warmupSteps) {
+    sim.setupRandom(numWaterDrops, 1);
+    sim.reserve(numWaterDrops);
+    for (int i = 0; i < warmupSteps; i++) {
+        sim.step(benchmarkDeltaTime);
+    }
+}
+
+double median(vector<double> &values) {
+    size_t middle = values.size() / 2;
+    nth_element(values.begin(), values.begin() + middle, values.end());
+    return values[middle];
+}
@@ -0,0 +1,23 @@
+#ifndef BENCHMARKSETUP_H
+#define BENCHMARKSETUP_H
+
+#include <vector>
+
+class Simulation;
+
+// The scene the headless benchmarks and checks measure, so their numbers
+// stay comparable with each other
+
+// Time step the harnesses advance by
+const float benchmarkDeltaTime = 1.0f / 60.0f;
+
+// Fills sim with numWaterDrops drops from a fixed seed, reserves room for
+// them and steps it warmupSteps times, so the buffers have grown and the
+// drops left their starting lattice before anything is measured. Set the
+// box and gravity on sim beforehand.
+void warmUpSimulation(Simulation &sim, int numWaterDrops, int warmupSteps = 20);
+
+// Median of values, which get reordered
+double median(std::vector<double> &values);
+
+#endif // BENCHMARKSETUP_H
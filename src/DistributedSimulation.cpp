@@ -0,0 +1,253 @@
+#include "DistributedSimulation.h"
+#include "SocketTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Wire format of a drop
+struct PackedDrop {
+    float position[3];
+    float velocity[3];
+    float radius;
+};
+
+PackedDrop pack(const WaterDrop &drop) {
+    PackedDrop packed = {
+        { drop.position.x, drop.position.y, drop.position.z },
+        { drop.velocity.x, drop.velocity.y, drop.velocity.z },
+        drop.radius
+    };
+    return packed;
+}
+
+void unpack(const vector<char> &buffer, vector<WaterDrop> &out, HeapCounter &counter) {
+    size_t count = buffer.size() / sizeof(PackedDrop);
+    reserveBuffer(out, out.size() + count, counter);
+    for (size_t i = 0; i < count; i++) {
+        PackedDrop packed;
+        memcpy(&packed, buffer.data() + i * sizeof(PackedDrop), sizeof(PackedDrop));
+        WaterDrop drop(packed.position[0], packed.position[1], packed.position[2], packed.radius);
+        drop.velocity = vec3(packed.velocity[0], packed.velocity[1], packed.velocity[2]);
+        out.push_back(drop);
+    }
+}
+
+} // namespace
+
+DistributedSimulation::DistributedSimulation(Transport &transport, Simulation &sim)
+    : transport(transport), sim(sim) {
+    numOwned = (int)sim.water.size();
+
+    int rank = transport.rank();
+    int first = rank % 2 == 0 ? rank + 1 : rank - 1;
+    int second = rank % 2 == 0 ? rank - 1 : rank + 1;
+    if (first >= 0 && first < transport.size()) neighbors[numNeighbors++] = first;
+    if (second >= 0 && second < transport.size()) neighbors[numNeighbors++] = second;
+}
+
+int DistributedSimulation::ownerOf(float x) const {
+    float slabWidth = sim.width / transport.size();
+    int owner = (int)floor((x + sim.width / 2) / slabWidth);
+    return std::max(0, std::min(transport.size() - 1, owner));
+}
+
+void DistributedSimulation::scatter() {
+    int rank = transport.rank();
+    sim.water.erase(remove_if(sim.water.begin(), sim.water.end(),
+        [&](const WaterDrop &drop) { return ownerOf(drop.position.x) != rank; }), sim.water.end());
+    numOwned = (int)sim.water.size();
+}
+
+bool DistributedSimulation::exchange(int peer, const char *data, size_t size) {
+    size_t capacity = incoming.capacity();
+    bool ok = transport.exchange(peer, data, size, incoming);
+    if (incoming.capacity() > capacity) {
+        sim.bufferAllocations.add(incoming.capacity());
+    }
+    return ok;
+}
+
+bool DistributedSimulation::migrate() {
+    int rank = transport.rank();
+
+    // Drops heading further than a neighbor go to the neighbor on that side
+    // and carry on from there next step
+    PackedDrop *outgoing[2];
+    int outgoingCount[2] = { 0, 0 };
+    for (int n = 0; n < numNeighbors; n++) {
+        outgoing[n] = sim.arena.allocate<PackedDrop>(numOwned);
+    }
+
+    staying.clear();
+    reserveBuffer(staying, numOwned, sim.bufferAllocations);
+    for (const WaterDrop &drop : sim.water) {
+        int owner = ownerOf(drop.position.x);
+        if (owner == rank) {
+            staying.push_back(drop);
+            continue;
+        }
+        int towards = owner < rank ? rank - 1 : rank + 1;
+        for (int n = 0; n < numNeighbors; n++) {
+            if (neighbors[n] == towards) outgoing[n][outgoingCount[n]++] = pack(drop);
+        }
+    }
+    sim.water.swap(staying);
+
+    for (int n = 0; n < numNeighbors; n++) {
+        if (!exchange(neighbors[n], (const char *)outgoing[n], outgoingCount[n] * sizeof(PackedDrop))) return false;
+        unpack(incoming, sim.water, sim.bufferAllocations);
+    }
+    numOwned = (int)sim.water.size();
+    return true;
+}
+
+bool DistributedSimulation::exchangeGhosts() {
+    int rank = transport.rank();
+    float slabWidth = sim.width / transport.size();
+    float left = -sim.width / 2 + rank * slabWidth;
+    float right = left + slabWidth;
+
+    // A drop is a ghost for a neighbor if either its position or its
+    // predicted position is within a kernel radius of their shared edge
+    PackedDrop *outgoing = sim.arena.allocate<PackedDrop>(numOwned);
+    for (int n = 0; n < numNeighbors; n++) {
+        haloSent[n] = sim.arena.allocate<int>(numOwned);
+        haloCount[n] = 0;
+        for (int i = 0; i < numOwned; i++) {
+            float x = sim.water[i].position.x;
+            float predictedX = sim.predictedPositions[i].x;
+            bool inHalo = neighbors[n] < rank
+                ? std::min(x, predictedX) < left + sim.kernelRadius
+                : std::max(x, predictedX) > right - sim.kernelRadius;
+            if (inHalo) {
+                outgoing[haloCount[n]] = pack(sim.water[i]);
+                haloSent[n][haloCount[n]++] = i;
+            }
+        }
+        if (!exchange(neighbors[n], (const char *)outgoing, haloCount[n] * sizeof(PackedDrop))) return false;
+        ghostStart[n] = (int)sim.water.size();
+        unpack(incoming, sim.water, sim.bufferAllocations);
+        ghostCount[n] = (int)sim.water.size() - ghostStart[n];
+    }
+    return true;
+}
+
+bool DistributedSimulation::exchangeGhostDensities() {
+    for (int n = 0; n < numNeighbors; n++) {
+        float *outgoing = sim.arena.allocate<float>(haloCount[n]);
+        for (int k = 0; k < haloCount[n]; k++) {
+            outgoing[k] = sim.densities[haloSent[n][k]];
+        }
+        if (!exchange(neighbors[n], (const char *)outgoing, haloCount[n] * sizeof(float))) return false;
+        if (incoming.size() != ghostCount[n] * sizeof(float)) {
+            cerr << "Rank " << transport.rank() << ": ghost density count mismatch" << endl;
+            return false;
+        }
+        if (ghostCount[n] == 0) continue;
+        memcpy(&sim.densities[ghostStart[n]], incoming.data(), incoming.size());
+    }
+    return true;
+}
+
+bool DistributedSimulation::step(float deltaTime) {
+    sim.beginStep();
+
+    // Ghosts from the last step are stale
+    sim.water.resize(numOwned);
+
+    if (!migrate()) return false;
+    sim.predictPositions();
+    if (!exchangeGhosts()) return false;
+
+    // Only the ghosts just appended lack predictions
+    sim.predictPositions(numOwned);
+    sim.updateGrid();
+    sim.computeDensities(numOwned);
+    if (!exchangeGhostDensities()) return false;
+    sim.integrate(deltaTime, numOwned);
+    return true;
+}
+
+bool DistributedSimulation::gather(vector<WaterDrop> &all) {
+    all.clear();
+    vector<char> buffer(numOwned * sizeof(PackedDrop));
+    for (int i = 0; i < numOwned; i++) {
+        PackedDrop packed = pack(sim.water[i]);
+        memcpy(buffer.data() + i * sizeof(PackedDrop), &packed, sizeof(PackedDrop));
+    }
+    if (transport.rank() != 0) {
+        return transport.send(0, buffer.data(), buffer.size());
+    }
+
+    HeapCounter ignored;
+    unpack(buffer, all, ignored);
+    for (int peer = 1; peer < transport.size(); peer++) {
+        if (!transport.receive(peer, buffer)) return false;
+        unpack(buffer, all, ignored);
+    }
+    return true;
+}
+
+int runDistributed(int ranks, int numWaterDrops, int steps) {
+    // Every rank builds the same starting layout and keeps its own slab.
+    // It is made before forking, while the simulation has no worker threads.
+    Simulation sim(1);
+    sim.setupRandom(numWaterDrops, 1);
+    if (ranks < 1 || sim.width / ranks < sim.kernelRadius) {
+        cerr << "At most " << (int)(sim.width / sim.kernelRadius) << " ranks fit a " << sim.width
+             << " wide box, as each slab must be at least a kernel radius (" << sim.kernelRadius << ") wide" << endl;
+        return 1;
+    }
+
+    unique_ptr<SocketTransport> transport = SocketTransport::launch(ranks);
+    if (!transport) return 1;
+
+    // Sharing out the cores between the ranks
+    sim.setThreadCount(std::max(1, (int)thread::hardware_concurrency() / ranks));
+    DistributedSimulation distributed(*transport, sim);
+    distributed.scatter();
+
+    bool ok = true;
+    vector<WaterDrop> all;
+    auto start = chrono::high_resolution_clock::now();
+    for (int step = 1; step <= steps && ok; step++) {
+        ok = distributed.step(0.016f); // 60 fps
+
+        if (ok && (step % 60 == 0 || step == steps)) {
+            ok = distributed.gather(all);
+            if (ok && transport->rank() == 0) {
+                float kineticEnergy = 0;
+                for (const WaterDrop &drop : all) {
+                    kineticEnergy += 0.5f * dot(drop.velocity, drop.velocity);
+                }
+                double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+                cout << "Step " << step << ": " << all.size() << " drops, kinetic energy " << kineticEnergy
+                     << ", " << step / seconds << " steps/s, " << sim.stepAllocations().allocations
+                     << " heap allocations last step" << endl;
+            }
+        }
+    }
+
+    if (!ok) {
+        cerr << "Rank " << transport->rank() << " lost contact with its peers" << endl;
+    }
+    cerr << "Rank " << transport->rank() << ": " << distributed.getOwnedCount() << " owned, "
+         << distributed.getGhostCount() << " ghosts" << endl;
+
+    if (transport->rank() != 0) {
+        transport.reset();
+        std::_Exit(ok ? 0 : 1);
+    }
+    ok = transport->waitForWorkers() && ok;
+    return ok ? 0 : 1;
+}
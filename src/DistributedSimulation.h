@@ -0,0 +1,68 @@
+#ifndef DISTRIBUTEDSIMULATION_H
+#define DISTRIBUTEDSIMULATION_H
+
+#include <vector>
+
+#include "Simulation.h"
+#include "Transport.h"
+
+// Splits the box into vertical slabs, one per rank. Each rank integrates the
+// drops it owns and keeps a kernelRadius wide halo of ghost copies of its
+// neighbors' drops for the neighbor sums. Every step migrates drops that
+// left the slab, refreshes the ghosts, and after the density pass sends the
+// neighbors the densities of the drops they hold as ghosts. Halos only
+// reach the adjacent ranks, so every slab must be at least kernelRadius wide.
+class DistributedSimulation {
+public:
+    DistributedSimulation(Transport &transport, Simulation &sim);
+
+    // Drops everything outside this rank's slab. Every rank should start from
+    // the same set of drops.
+    void scatter();
+
+    bool step(float deltaTime);
+
+    // Collects the owned drops of every rank on rank 0. Other ranks send
+    // theirs and leave all empty.
+    bool gather(std::vector<WaterDrop> &all);
+
+    int getOwnedCount() const { return numOwned; }
+    int getGhostCount() const { return (int)sim.water.size() - numOwned; }
+
+private:
+    int ownerOf(float x) const;
+
+    bool migrate();
+    bool exchangeGhosts();
+    bool exchangeGhostDensities();
+
+    // Receives from a neighbor into the persistent incoming buffer
+    bool exchange(int peer, const char *data, size_t size);
+
+    Transport &transport;
+    Simulation &sim;
+    int numOwned = 0;
+
+    // Neighbor ranks in the order this rank talks to them. Pairing even
+    // ranks with their right neighbor first and odd ranks with their left
+    // neighbor first lets every exchange proceed without waiting on a chain.
+    int neighbors[2];
+    int numNeighbors = 0;
+
+    // Owned drops sent to each neighbor as ghosts, and where that neighbor's
+    // ghosts start in sim.water. The lists live in the step arena.
+    int *haloSent[2];
+    int haloCount[2];
+    int ghostStart[2];
+    int ghostCount[2];
+
+    // Kept across steps so a warm step does not allocate
+    std::vector<WaterDrop> staying;
+    std::vector<char> incoming;
+};
+
+// Runs the simulation for the given number of steps split across ranks
+// processes, printing totals gathered on rank 0 every 60 steps
+int runDistributed(int ranks, int numWaterDrops, int steps);
+
+#endif // DISTRIBUTEDSIMULATION_H
@@ -0,0 +1,24 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <glm/glm.hpp>
+
+// Point that adds drops while the simulation runs
+struct Emitter {
+    glm::vec2 position = glm::vec2(0, 0);
+    glm::vec2 velocity = glm::vec2(0, 0);
+    float rate = 60;   // drops per second
+    float spread = 0;  // random offset around position
+    float radius = 0.1f;
+
+    // Fraction of a drop carried over to the next step
+    float pending = 0;
+};
+
+// Rectangle that removes every drop entering it
+struct Sink {
+    glm::vec2 min = glm::vec2(-1, -1);
+    glm::vec2 max = glm::vec2(1, 1);
+};
+
+#endif // EMITTER_H
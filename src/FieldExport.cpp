@@ -0,0 +1,34 @@
+#include "FieldExport.h"
+#include "BenchmarkSetup.h"
+#include "FieldRasterizer.h"
+#include "Simulation.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+int runFieldExport(int numWaterDrops, int steps, const string &outputFile) {
+    Simulation sim;
+    sim.gravity = glm::vec3(0, -4, 0);
+    warmUpSimulation(sim, numWaterDrops);
+
+    FieldRasterizer field;
+    double totalMs = 0;
+    for (int i = 0; i < steps; i++) {
+        sim.step(benchmarkDeltaTime);
+        auto start = chrono::high_resolution_clock::now();
+        field.rasterize(sim);
+        totalMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    cout << "Field rasterization: " << numWaterDrops << " drops onto " << field.getGridWidth() << "x"
+         << field.getGridHeight() << " nodes, " << sim.scheduler->getThreadCount() << " threads, "
+         << fixed << setprecision(3) << totalMs / steps << " ms" << endl;
+
+    if (!outputFile.empty() && !field.writeCsv(outputFile)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef FIELDEXPORT_H
+#define FIELDEXPORT_H
+
+#include <string>
+
+// Steps a simulation of numWaterDrops, rasterizing its fields after every
+// step, prints the time that takes and writes the last grid to outputFile
+// as CSV unless it is empty. Needs no window.
+int runFieldExport(int numWaterDrops, int steps = 60, const std::string &outputFile = "");
+
+#endif // FIELDEXPORT_H
@@ -0,0 +1,188 @@
+#include "FieldRasterizer.h"
+#include "Simulation.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+const char *FieldRasterizer::channelName(int channel) {
+    switch (channel) {
+    case Weight: return "weight";
+    case Density: return "density";
+    case VelocityX: return "velocity_x";
+    case VelocityY: return "velocity_y";
+    case Pressure: return "pressure";
+    }
+    return "";
+}
+
+void FieldRasterizer::resize(float width, float height) {
+    int cells = std::max(tileCells, 1);
+    if (width == builtWidth && height == builtHeight && cellSize == spacing && cells == cellsPerTile) return;
+    builtWidth = width;
+    builtHeight = height;
+    spacing = cellSize;
+    cellsPerTile = cells;
+    origin = vec2(-width / 2, -height / 2);
+    nodesX = (int)ceil(width / spacing) + 1;
+    nodesY = (int)ceil(height / spacing) + 1;
+    for (vector<float> &channel : channels) {
+        channel.assign(nodesX * nodesY, 0.0f);
+    }
+
+    // Drops land in cells up to nodes - 2, so the last tile of a row or
+    // column holds those and owns the far edge's nodes
+    tilesX = (nodesX - 2) / cellsPerTile + 1;
+    tilesY = (nodesY - 2) / cellsPerTile + 1;
+    int side = cellsPerTile + 1;
+    tileSums.assign(tilesX * tilesY * side * side * NumChannels, 0.0f);
+    bandTasks.clear();
+    for (int ty = 0; ty < tilesY; ty++) {
+        int rows = ty + 1 < tilesY ? cellsPerTile : nodesY - ty * cellsPerTile;
+        bandTasks.push_back({ ty, ty + 1, rows * nodesX });
+    }
+}
+
+void FieldRasterizer::rasterize(const Simulation &sim) {
+    int count = (int)std::min(sim.water.size(), sim.densities.size());
+    TraceSpan span("rasterize", "field", "drops", count);
+    resize(sim.width, sim.height);
+
+    binDrops(sim, count);
+    tileTasks.clear();
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        int drops = tileStarts[tile + 1] - tileStarts[tile];
+        if (drops > 0) tileTasks.push_back({ tile, tile + 1, drops });
+    }
+    sim.scheduler->run(tileTasks, [&](const Task &task, int) {
+        depositTile(sim, task.begin);
+    });
+    // A band reads the top row of the tiles below it, so waits for every
+    // deposit
+    sim.scheduler->run(bandTasks, [&](const Task &task, int) {
+        mergeBand(task.begin);
+    });
+}
+
+void FieldRasterizer::binDrops(const Simulation &sim, int count) {
+    float inverseSpacing = 1 / spacing;
+    dropTiles.resize(count);
+    tileDrops.resize(count);
+    tileStarts.assign(tilesX * tilesY + 1, 0);
+    for (int i = 0; i < count; i++) {
+        vec2 position = (vec2(sim.water[i].position) - origin) * inverseSpacing;
+        int x = std::min(std::max((int)floor(position.x), 0), nodesX - 2);
+        int y = std::min(std::max((int)floor(position.y), 0), nodesY - 2);
+        dropTiles[i] = y / cellsPerTile * tilesX + x / cellsPerTile;
+        tileStarts[dropTiles[i] + 1]++;
+    }
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        tileStarts[tile + 1] += tileStarts[tile];
+    }
+    // Filled back to front from each tile's end as in SurfaceExtractor, so
+    // drops keep their index order within a tile
+    for (int i = count - 1; i >= 0; i--) {
+        tileDrops[--tileStarts[dropTiles[i] + 1]] = i;
+    }
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        tileStarts[tile] = tileStarts[tile + 1];
+    }
+    tileStarts[tilesX * tilesY] = count;
+}
+
+void FieldRasterizer::depositTile(const Simulation &sim, int tile) {
+    int side = cellsPerTile + 1;
+    float *sums = &tileSums[tile * side * side * NumChannels];
+    fill(sums, sums + side * side * NumChannels, 0.0f);
+    int x0 = tile % tilesX * cellsPerTile;
+    int y0 = tile / tilesX * cellsPerTile;
+    float inverseSpacing = 1 / spacing;
+    for (int k = tileStarts[tile]; k < tileStarts[tile + 1]; k++) {
+        int i = tileDrops[k];
+        const WaterDrop &drop = sim.water[i];
+        vec2 position = (vec2(drop.position) - origin) * inverseSpacing;
+        int x = std::min(std::max((int)floor(position.x), 0), nodesX - 2);
+        int y = std::min(std::max((int)floor(position.y), 0), nodesY - 2);
+        float fx = clamp(position.x - x, 0.0f, 1.0f);
+        float fy = clamp(position.y - y, 0.0f, 1.0f);
+        float values[NumChannels] = { 1, sim.densities[i], drop.velocity.x, drop.velocity.y,
+                                      sim.densityToPressure(sim.densities[i]) };
+        float weights[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+        for (int corner = 0; corner < 4; corner++) {
+            float *node = sums + ((y - y0 + (corner >> 1)) * side + x - x0 + (corner & 1)) * NumChannels;
+            for (int channel = 0; channel < NumChannels; channel++) {
+                node[channel] += weights[corner] * values[channel];
+            }
+        }
+    }
+}
+
+void FieldRasterizer::mergeBand(int tileRow) {
+    int side = cellsPerTile + 1;
+    int y0 = tileRow * cellsPerTile;
+    int y1 = tileRow + 1 < tilesY ? y0 + cellsPerTile : nodesY;
+    for (int channel = 0; channel < NumChannels; channel++) {
+        fill(channels[channel].begin() + y0 * nodesX, channels[channel].begin() + y1 * nodesX, 0.0f);
+    }
+
+    // The band's nodes take the rows of its own tiles, and its bottom row
+    // also takes the top border row of the tiles below
+    for (int ty = std::max(tileRow - 1, 0); ty <= tileRow; ty++) {
+        int rowBegin = std::max(y0, ty * cellsPerTile);
+        int rowEnd = std::min(y1, ty * cellsPerTile + side);
+        for (int tx = 0; tx < tilesX; tx++) {
+            int tile = ty * tilesX + tx;
+            if (tileStarts[tile] == tileStarts[tile + 1]) continue;
+            int x0 = tx * cellsPerTile;
+            int columns = std::min(side, nodesX - x0);
+            const float *sums = &tileSums[tile * side * side * NumChannels];
+            for (int y = rowBegin; y < rowEnd; y++) {
+                const float *row = sums + (y - ty * cellsPerTile) * side * NumChannels;
+                for (int x = 0; x < columns; x++) {
+                    for (int channel = 0; channel < NumChannels; channel++) {
+                        channels[channel][y * nodesX + x0 + x] += row[x * NumChannels + channel];
+                    }
+                }
+            }
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < nodesX; x++) {
+            float weight = channels[Weight][y * nodesX + x];
+            float inverseWeight = weight > 0 ? 1 / weight : 0;
+            for (int channel = Density; channel < NumChannels; channel++) {
+                channels[channel][y * nodesX + x] *= inverseWeight;
+            }
+        }
+    }
+}
+
+bool FieldRasterizer::writeCsv(const string &file) const {
+    ofstream out(file);
+    if (!out.is_open()) {
+        cerr << "Could not open file: '" << file << "'" << endl;
+        return false;
+    }
+    out << "x,y";
+    for (int channel = 0; channel < NumChannels; channel++) {
+        out << "," << channelName(channel);
+    }
+    out << endl;
+    for (int y = 0; y < nodesY; y++) {
+        for (int x = 0; x < nodesX; x++) {
+            vec2 point = gridPoint(x, y);
+            out << point.x << "," << point.y;
+            for (int channel = 0; channel < NumChannels; channel++) {
+                out << "," << value(channel, x, y);
+            }
+            out << endl;
+        }
+    }
+    return true;
+}
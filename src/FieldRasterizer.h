@@ -0,0 +1,79 @@
+#ifndef FIELDRASTERIZER_H
+#define FIELDRASTERIZER_H
+
+#include "TaskScheduler.h"
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class Simulation;
+
+// Particle to grid transfer of the fluid's state onto nodes every cellSize
+// over the box, for drawing and exporting the fields without a loop over
+// every particle per pixel. Each drop is deposited onto the four corners of
+// its cell with bilinear weights, and the channels other than Weight are
+// the weighted means of the drops around a node (zero where none reach).
+//
+// The drops are binned by the tile of cells they fall in, and each tile
+// runs on the scheduler depositing its drops into a buffer of its own nodes
+// plus the row and column of nodes past its top and right edges. Each band
+// of one tile row then sums those buffers into the channels, so no two
+// threads ever write the same node and nothing needs atomics.
+class FieldRasterizer {
+public:
+    enum Channel { Weight, Density, VelocityX, VelocityY, Pressure, NumChannels };
+    static const char *channelName(int channel);
+
+    // Node spacing, applied on the next rasterize()
+    float cellSize = 0.1f;
+    // Cells along the side of a tile, applied on the next rasterize()
+    int tileCells = 16;
+
+    // Rasterizes the drops of sim, whose densities must be current
+    void rasterize(const Simulation &sim);
+
+    int getGridWidth() const { return nodesX; }
+    int getGridHeight() const { return nodesY; }
+    glm::vec2 gridPoint(int x, int y) const { return origin + glm::vec2(x, y) * spacing; }
+
+    // Row-major node values of a channel, getGridWidth() per row
+    const std::vector<float> &getChannel(int channel) const { return channels[channel]; }
+    float value(int channel, int x, int y) const { return channels[channel][y * nodesX + x]; }
+
+    // Writes one row per node with its position and every channel
+    bool writeCsv(const std::string &file) const;
+
+private:
+    void resize(float width, float height);
+    void binDrops(const Simulation &sim, int count);
+    void depositTile(const Simulation &sim, int tile);
+    void mergeBand(int tileRow);
+
+    float builtWidth = 0;
+    float builtHeight = 0;
+    float spacing = 0;
+    int cellsPerTile = 0;
+    glm::vec2 origin = glm::vec2(0, 0);
+    int nodesX = 0;
+    int nodesY = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+
+    // Indices of the drops sorted by the tile their cell is in: tileStarts[t]
+    // to tileStarts[t + 1] index into tileDrops
+    std::vector<int> tileStarts;
+    std::vector<int> tileDrops;
+    std::vector<int> dropTiles;
+
+    // NumChannels sums per node for each tile, (cellsPerTile + 1) nodes on a
+    // side with the tile's lower left node first
+    std::vector<float> tileSums;
+
+    std::vector<Task> tileTasks;
+    std::vector<Task> bandTasks;
+
+    std::vector<float> channels[NumChannels];
+};
+
+#endif // FIELDRASTERIZER_H
@@ -0,0 +1,58 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t initialSize) {
+    addBlock(initialSize);
+}
+
+FrameArena::~FrameArena() {
+    for (const Block &block : blocks) {
+        delete[] block.data;
+    }
+}
+
+void FrameArena::addBlock(size_t size) {
+    blocks.push_back({ new char[size], size });
+    offset = 0;
+    heap.add(size);
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+    Block &block = blocks.back();
+    uintptr_t base = (uintptr_t)block.data;
+    size_t start = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+
+    if (start + bytes > block.size) {
+        // Double up so a growing step settles on a block size quickly
+        addBlock(std::max(bytes + alignment, block.size * 2));
+        return allocate(bytes, alignment);
+    }
+
+    offset = start + bytes;
+    used += bytes;
+    peak = std::max(peak, used);
+    return block.data + start;
+}
+
+void FrameArena::reset() {
+    if (blocks.size() > 1) {
+        size_t total = capacity();
+        for (const Block &block : blocks) {
+            delete[] block.data;
+        }
+        blocks.clear();
+        addBlock(total);
+    }
+    offset = 0;
+    used = 0;
+}
+
+size_t FrameArena::capacity() const {
+    size_t total = 0;
+    for (const Block &block : blocks) {
+        total += block.size;
+    }
+    return total;
+}
@@ -0,0 +1,99 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Heap allocations made on behalf of the simulation, so a warm step can be
+// checked to allocate nothing
+struct HeapCounter {
+    int allocations = 0;
+    size_t bytes = 0;
+
+    void add(size_t size) {
+        allocations++;
+        bytes += size;
+    }
+
+    HeapCounter operator+(const HeapCounter &other) const {
+        HeapCounter sum = *this;
+        sum.allocations += other.allocations;
+        sum.bytes += other.bytes;
+        return sum;
+    }
+    HeapCounter operator-(const HeapCounter &other) const {
+        HeapCounter difference = *this;
+        difference.allocations -= other.allocations;
+        difference.bytes -= other.bytes;
+        return difference;
+    }
+};
+
+// Resizes a persistent buffer, growing it with some headroom and recording
+// the allocation when its capacity is exceeded. Shrinking keeps the memory.
+template <typename Buffer>
+void resizeBuffer(Buffer &buffer, size_t size, HeapCounter &counter) {
+    if (size > buffer.capacity()) {
+        size_t capacity = size + size / 4;
+        buffer.reserve(capacity);
+        counter.add(capacity * sizeof(typename Buffer::value_type));
+    }
+    buffer.resize(size);
+}
+
+// Same for buffers that are appended to
+template <typename Buffer>
+void reserveBuffer(Buffer &buffer, size_t capacity, HeapCounter &counter) {
+    if (capacity > buffer.capacity()) {
+        capacity += capacity / 4;
+        buffer.reserve(capacity);
+        counter.add(capacity * sizeof(typename Buffer::value_type));
+    }
+}
+
+// Bump allocator for temporaries that only live for one step. Nothing is
+// freed individually; reset() releases everything at once. A step that
+// spills past the current block gets extra blocks, which reset() merges into
+// a single block big enough for the whole step, so once warm the arena never
+// touches the heap. Not thread safe: the simulation's arena is only
+// allocated from by the thread that calls step(), never by the workers.
+class FrameArena {
+public:
+    explicit FrameArena(size_t initialSize = 64 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T *allocate(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void reset();
+
+    size_t bytesUsed() const { return used; }
+    size_t peakBytes() const { return peak; }
+    size_t capacity() const;
+
+    // Heap allocations made by the arena itself since it was created
+    const HeapCounter &heapAllocations() const { return heap; }
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    void addBlock(size_t size);
+
+    std::vector<Block> blocks;
+    size_t offset = 0;  // bump pointer within the last block
+    size_t used = 0;    // bytes handed out since the last reset
+    size_t peak = 0;
+    HeapCounter heap;
+};
+
+#endif // FRAMEARENA_H
@@ -167,4 +167,25 @@ void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean
 	}
 }
 
+static GLuint currentProgram = 0;
+static GLuint currentVertexArray = 0;
+
+void useProgram(GLuint program)
+{
+	if (program != currentProgram)
+	{
+		glUseProgram(program);
+		currentProgram = program;
+	}
+}
+
+void bindVertexArray(GLuint vertexArray)
+{
+	if (vertexArray != currentVertexArray)
+	{
+		glBindVertexArray(vertexArray);
+		currentVertexArray = vertexArray;
+	}
+}
+
 }
@@ -25,6 +25,11 @@ namespace GLSL
 	void enableVertexAttribArray(const GLint handle);
 	void disableVertexAttribArray(const GLint handle);
 	void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+
+	// Binds that skip the GL call when the object is already bound. The
+	// cache only holds if every bind of that kind goes through these.
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
 }
 
 
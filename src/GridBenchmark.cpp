@@ -0,0 +1,114 @@
+#include "GridBenchmark.h"
+#include "BenchmarkSetup.h"
+#include "UniformGrid.h"
+#include "SpatialHashGrid.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const float width = 18;
+const float height = 12;
+const float cellSize = 0.9f;
+const float radius = 0.1f;
+
+struct Scene {
+    const char *name;
+    float speed; // max particle speed in units per second
+};
+
+// Moves particles by their velocity and bounces them off the box, keeping
+// them a radius inside the walls like WaterDrop::ResolveOutOfBounds does
+void advance(vector<vec3> &positions, vector<vec3> &velocities, float deltaTime) {
+    float right = width / 2 - radius;
+    float top = height / 2 - radius;
+    for (size_t i = 0; i < positions.size(); i++) {
+        positions[i] += velocities[i] * deltaTime;
+        if (fabs(positions[i].x) > right) {
+            velocities[i].x *= -1;
+            positions[i].x = std::max(-right, std::min(right, positions[i].x));
+        }
+        if (fabs(positions[i].y) > top) {
+            velocities[i].y *= -1;
+            positions[i].y = std::max(-top, std::min(top, positions[i].y));
+        }
+    }
+}
+
+// Runs the scene twice from the same seed, once rebuilding the grid every
+// frame and once updating it, and returns the median milliseconds a frame
+// spent in each, which one busy frame can't skew
+void timeScene(SpatialGrid &grid, const Scene &scene, int numParticles, int frames,
+               double &buildMs, double &updateMs, double &movedFraction, double &patchedFraction) {
+    for (int pass = 0; pass < 2; pass++) {
+        mt19937 gen(42);
+        uniform_real_distribution<float> xDistrib(-width / 2 + radius, width / 2 - radius);
+        uniform_real_distribution<float> yDistrib(-height / 2 + radius, height / 2 - radius);
+        uniform_real_distribution<float> vDistrib(-scene.speed, scene.speed);
+
+        vector<vec3> positions(numParticles), velocities(numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            positions[i] = vec3(xDistrib(gen), yDistrib(gen), 0);
+            velocities[i] = vec3(vDistrib(gen), vDistrib(gen), 0);
+        }
+
+        grid.setCellSize(cellSize);
+        grid.build(positions);
+
+        vector<double> times(frames);
+        long moved = 0;
+        int patched = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            advance(positions, velocities, 1.0f / 60.0f);
+
+            auto start = chrono::high_resolution_clock::now();
+            if (pass == 0) {
+                grid.build(positions);
+            } else {
+                grid.update(positions);
+                moved += grid.getMovedCount();
+                patched += grid.wasIncremental();
+            }
+            times[frame] = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        }
+
+        if (pass == 0) {
+            buildMs = median(times);
+        } else {
+            updateMs = median(times);
+            movedFraction = moved / (double)frames / numParticles;
+            patchedFraction = patched / (double)frames;
+        }
+    }
+}
+
+} // namespace
+
+void runGridBenchmark(int numParticles, int frames) {
+    Scene scenes[] = { { "settled", 0.5f }, { "splashing", 20.0f } };
+    shared_ptr<SpatialGrid> grids[] = { make_shared<UniformGrid>(width, height), make_shared<SpatialHashGrid>() };
+
+    cout << "Grid benchmark: " << numParticles << " particles, " << frames << " frames" << endl;
+    cout << left << setw(10) << "backend" << setw(12) << "scene" << setw(10) << "moved %" << setw(11) << "patched %"
+         << setw(12) << "build ms" << setw(12) << "update ms" << "speedup" << endl;
+
+    for (auto &grid : grids) {
+        for (const Scene &scene : scenes) {
+            double buildMs, updateMs, movedFraction, patchedFraction;
+            timeScene(*grid, scene, numParticles, frames, buildMs, updateMs, movedFraction, patchedFraction);
+            cout << left << setw(10) << grid->name() << setw(12) << scene.name
+                 << setw(10) << fixed << setprecision(2) << movedFraction * 100
+                 << setw(11) << setprecision(0) << patchedFraction * 100
+                 << setw(12) << setprecision(3) << buildMs << setw(12) << updateMs
+                 << setprecision(2) << buildMs / updateMs << "x" << endl;
+        }
+    }
+}
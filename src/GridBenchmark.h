@@ -0,0 +1,9 @@
+#ifndef GRIDBENCHMARK_H
+#define GRIDBENCHMARK_H
+
+// Times full grid rebuilds against incremental updates on a settled scene
+// (particles jiggling in place) and a splashing one (fast random motion) for
+// each grid backend, and prints the speedup. Needs no window.
+void runGridBenchmark(int numParticles, int frames = 200);
+
+#endif // GRIDBENCHMARK_H
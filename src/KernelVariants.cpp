@@ -0,0 +1,158 @@
+#include "KernelVariants.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Same constants as the scalar kernels
+float kernelScale(float kernelRadius) {
+    return (float)(6 / (3.1415 * pow(kernelRadius, 4)));
+}
+
+float derivativeScale(float kernelRadius) {
+    return (float)(12 / (pow(kernelRadius, 4) * 3.1415));
+}
+
+} // namespace
+
+void smoothingKernelBatch(float kernelRadius, const float *distances, float *out, int count) {
+    float scale = kernelScale(kernelRadius);
+    for (int i = 0; i < count; i++) {
+        float falloff = std::max(kernelRadius - distances[i], 0.0f);
+        out[i] = falloff * falloff * scale;
+    }
+}
+
+void smoothingKernelDerivativeBatch(float kernelRadius, const float *distances, float *out, int count) {
+    float scale = derivativeScale(kernelRadius);
+    for (int i = 0; i < count; i++) {
+        out[i] = std::min(distances[i] - kernelRadius, 0.0f) * scale;
+    }
+}
+
+void densityToPressureBatch(float targetDensity, float pressureMultiplier, const float *densities, float *out, int count) {
+    for (int i = 0; i < count; i++) {
+        float pressure = (densities[i] - targetDensity) * pressureMultiplier;
+        out[i] = densities[i] < 0 ? 0 : pressure;
+    }
+}
+
+void reflectAxisBatch(float *position, float *velocity, float *across, const float *radius, float halfExtent,
+                      float damping, int count) {
+    for (int k = 0; k < count; k++) {
+        float high = halfExtent - radius[k];
+        float wall = std::min(std::max(position[k], -high), high);
+        float excess = std::fabs(position[k] - wall);
+        across[k] *= position[k] > high ? 0.5f : 1.0f;
+        velocity[k] *= excess > 0 ? -damping : 1.0f;
+        position[k] = excess < 0.1f ? wall : 2 * wall - position[k];
+    }
+}
+
+#ifdef __SSE2__
+
+void smoothingKernelSimd(float kernelRadius, const float *distances, float *out, int count) {
+    __m128 radius = _mm_set1_ps(kernelRadius);
+    __m128 scale = _mm_set1_ps(kernelScale(kernelRadius));
+    __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 falloff = _mm_max_ps(_mm_sub_ps(radius, _mm_loadu_ps(distances + i)), zero);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_mul_ps(falloff, falloff), scale));
+    }
+    smoothingKernelBatch(kernelRadius, distances + i, out + i, count - i);
+}
+
+void smoothingKernelDerivativeSimd(float kernelRadius, const float *distances, float *out, int count) {
+    __m128 radius = _mm_set1_ps(kernelRadius);
+    __m128 scale = _mm_set1_ps(derivativeScale(kernelRadius));
+    __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 slope = _mm_min_ps(_mm_sub_ps(_mm_loadu_ps(distances + i), radius), zero);
+        _mm_storeu_ps(out + i, _mm_mul_ps(slope, scale));
+    }
+    smoothingKernelDerivativeBatch(kernelRadius, distances + i, out + i, count - i);
+}
+
+void densityToPressureSimd(float targetDensity, float pressureMultiplier, const float *densities, float *out, int count) {
+    __m128 target = _mm_set1_ps(targetDensity);
+    __m128 multiplier = _mm_set1_ps(pressureMultiplier);
+    __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 density = _mm_loadu_ps(densities + i);
+        __m128 pressure = _mm_mul_ps(_mm_sub_ps(density, target), multiplier);
+        // Zero where the density is negative
+        _mm_storeu_ps(out + i, _mm_and_ps(pressure, _mm_cmpge_ps(density, zero)));
+    }
+    densityToPressureBatch(targetDensity, pressureMultiplier, densities + i, out + i, count - i);
+}
+
+void reflectAxisSimd(float *position, float *velocity, float *across, const float *radius, float halfExtent,
+                     float damping, int count) {
+    __m128 half = _mm_set1_ps(halfExtent);
+    __m128 bounce = _mm_set1_ps(-damping);
+    __m128 snap = _mm_set1_ps(0.1f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 slide = _mm_set1_ps(0.5f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 p = _mm_loadu_ps(position + k);
+        __m128 high = _mm_sub_ps(half, _mm_loadu_ps(radius + k));
+        __m128 wall = _mm_min_ps(_mm_max_ps(p, _mm_xor_ps(high, sign)), high);
+        __m128 excess = _mm_andnot_ps(sign, _mm_sub_ps(p, wall));
+
+        __m128 over = _mm_cmpgt_ps(p, high);
+        __m128 a = _mm_loadu_ps(across + k);
+        _mm_storeu_ps(across + k, _mm_or_ps(_mm_and_ps(over, _mm_mul_ps(a, slide)), _mm_andnot_ps(over, a)));
+
+        __m128 hit = _mm_cmpgt_ps(excess, zero);
+        __m128 v = _mm_loadu_ps(velocity + k);
+        _mm_storeu_ps(velocity + k, _mm_or_ps(_mm_and_ps(hit, _mm_mul_ps(v, bounce)), _mm_andnot_ps(hit, v)));
+
+        __m128 near = _mm_cmplt_ps(excess, snap);
+        __m128 mirrored = _mm_sub_ps(_mm_mul_ps(two, wall), p);
+        _mm_storeu_ps(position + k, _mm_or_ps(_mm_and_ps(near, wall), _mm_andnot_ps(near, mirrored)));
+    }
+    reflectAxisBatch(position + k, velocity + k, across + k, radius + k, halfExtent, damping, count - k);
+}
+
+#else
+
+void smoothingKernelSimd(float kernelRadius, const float *distances, float *out, int count) {
+    smoothingKernelBatch(kernelRadius, distances, out, count);
+}
+
+void smoothingKernelDerivativeSimd(float kernelRadius, const float *distances, float *out, int count) {
+    smoothingKernelDerivativeBatch(kernelRadius, distances, out, count);
+}
+
+void densityToPressureSimd(float targetDensity, float pressureMultiplier, const float *densities, float *out, int count) {
+    densityToPressureBatch(targetDensity, pressureMultiplier, densities, out, count);
+}
+
+void reflectAxisSimd(float *position, float *velocity, float *across, const float *radius, float halfExtent,
+                     float damping, int count) {
+    reflectAxisBatch(position, velocity, across, radius, halfExtent, damping, count);
+}
+
+#endif
+
+KernelTable::KernelTable(float kernelRadius, int samples)
+    : kernelRadius(kernelRadius), samples(samples), samplesPerUnit(samples / kernelRadius),
+      kernelValues(samples + 1), derivativeValues(samples + 1) {
+    for (int i = 0; i <= samples; i++) {
+        float distance = i / samplesPerUnit;
+        kernelValues[i] = Simulation::smoothingKernel(kernelRadius, distance);
+        derivativeValues[i] = Simulation::smoothingKernelDerivative(kernelRadius, distance);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef KERNELVARIANTS_H
+#define KERNELVARIANTS_H
+
+#include <vector>
+
+// Alternatives to the scalar Simulation kernels that work on whole arrays of
+// distances, for judging kernel-level optimizations. Results match the
+// scalar versions to float rounding; the tabulated ones to the table step.
+
+// Plain loops the compiler can vectorize on its own
+void smoothingKernelBatch(float kernelRadius, const float *distances, float *out, int count);
+void smoothingKernelDerivativeBatch(float kernelRadius, const float *distances, float *out, int count);
+void densityToPressureBatch(float targetDensity, float pressureMultiplier, const float *densities, float *out, int count);
+
+// One axis of WaterDrop::ResolveOutOfBounds for drops gathered into arrays
+// per field, in a box from -halfExtent to halfExtent. across is the other
+// velocity component, halved on hitting the high wall. The y axis goes
+// first, as in ResolveOutOfBounds.
+void reflectAxisBatch(float *position, float *velocity, float *across, const float *radius, float halfExtent,
+                      float damping, int count);
+
+// Explicit SSE, four at a time. Falls back to the batch loops without SSE.
+void smoothingKernelSimd(float kernelRadius, const float *distances, float *out, int count);
+void smoothingKernelDerivativeSimd(float kernelRadius, const float *distances, float *out, int count);
+void densityToPressureSimd(float targetDensity, float pressureMultiplier, const float *densities, float *out, int count);
+void reflectAxisSimd(float *position, float *velocity, float *across, const float *radius, float halfExtent,
+                     float damping, int count);
+
+// Kernel and derivative sampled over [0, kernelRadius] and linearly
+// interpolated, zero past the radius
+class KernelTable {
+public:
+    explicit KernelTable(float kernelRadius, int samples = 1024);
+
+    float kernel(float distance) const { return lookup(kernelValues, distance); }
+    float derivative(float distance) const { return lookup(derivativeValues, distance); }
+
+    float getKernelRadius() const { return kernelRadius; }
+
+private:
+    float lookup(const std::vector<float> &values, float distance) const {
+        float position = distance * samplesPerUnit;
+        int index = (int)position;
+        if (index >= samples) return 0;
+        float t = position - index;
+        return values[index] + (values[index + 1] - values[index]) * t;
+    }
+
+    float kernelRadius;
+    int samples;
+    float samplesPerUnit;
+    // One extra sample at the radius so lookups never read past the end
+    std::vector<float> kernelValues;
+    std::vector<float> derivativeValues;
+};
+
+#endif // KERNELVARIANTS_H
@@ -1,74 +1,87 @@
 
 #include "MatrixStack.h"
+#include <cassert>
+#include <cstdio>
 #include <glm/gtc/matrix_transform.hpp>
 
-static const int MaxMatrixSize = 100;
-
-
 MatrixStack::MatrixStack()
 {
-	stack.push(glm::mat4(1.0));
+	stack[0] = glm::mat4(1.0);
 }
 
 void MatrixStack::pushMatrix()
 {
-	const glm::mat4 &top = stack.top();
-	stack.push(top);
-	assert(stack.size() < MaxMatrixSize);
+	assert(depth < Capacity);
+	stack[depth] = stack[depth - 1];
+	depth++;
 }
 
 void MatrixStack::popMatrix()
 {
-	assert(!stack.empty());
-	stack.pop();
-
 	// There should always be one matrix left.
-	assert(!stack.empty());
+	assert(depth > 1);
+	depth--;
 }
 
 void MatrixStack::loadIdentity()
 {
-	glm::mat4 &top = stack.top();
+	glm::mat4 &top = stack[depth - 1];
 	top = glm::mat4(1.f);
 }
 
 void MatrixStack::perspective(float fovy, float aspect, float zNear, float zFar)
 {
-	glm::mat4 &top = stack.top();
+	glm::mat4 &top = stack[depth - 1];
 	top *= glm::perspective(fovy, aspect, zNear, zFar);
 }
 
+// Multiplying by a translation only changes the last column, and by a
+// scale only scales the columns, so neither needs the full product
 void MatrixStack::translate(const glm::vec3 &offset)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 t = glm::translate(glm::mat4(1.f), offset);
-	top *= t;
+	glm::mat4 &top = stack[depth - 1];
+	top[3] = top[0] * offset.x + top[1] * offset.y + top[2] * offset.z + top[3];
 }
 
 void MatrixStack::scale(const glm::vec3 &scaleV)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), scaleV);
-	top *= s;
+	glm::mat4 &top = stack[depth - 1];
+	top[0] *= scaleV.x;
+	top[1] *= scaleV.y;
+	top[2] *= scaleV.z;
 }
 
 void MatrixStack::scale(float size)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), glm::vec3(size));
-	top *= s;
+	scale(glm::vec3(size));
+}
+
+void MatrixStack::translateScale(const glm::vec3 &offset, float size)
+{
+	stack[depth - 1] = translatedScaled(offset, size);
+}
+
+glm::mat4 MatrixStack::translatedScaled(const glm::vec3 &offset, float size) const
+{
+	const glm::mat4 &top = stack[depth - 1];
+	glm::mat4 result;
+	result[0] = top[0] * size;
+	result[1] = top[1] * size;
+	result[2] = top[2] * size;
+	result[3] = top[0] * offset.x + top[1] * offset.y + top[2] * offset.z + top[3];
+	return result;
 }
 
 void MatrixStack::rotate(float angle, const glm::vec3 &axis)
 {
-	glm::mat4 &top = stack.top();
+	glm::mat4 &top = stack[depth - 1];
 	glm::mat4 r = glm::rotate(glm::mat4(1.0), angle, axis);
 	top *= r;
 }
 
 void MatrixStack::multMatrix(const glm::mat4 &matrix)
 {
-	glm::mat4 &top = stack.top();
+	glm::mat4 &top = stack[depth - 1];
 	top *= matrix;
 }
 
@@ -78,25 +91,25 @@ void MatrixStack::ortho(float left, float right, float bottom, float top, float
 	assert(bottom != top);
 	assert(zFar != zNear);
 
-	glm::mat4 &ctm = stack.top();
+	glm::mat4 &ctm = stack[depth - 1];
 	ctm *= glm::ortho(left, right, bottom, top, zNear, zFar);
 }
 
 void MatrixStack::frustum(float left, float right, float bottom, float top, float zNear, float zFar)
 {
-	glm::mat4 &ctm = stack.top();
+	glm::mat4 &ctm = stack[depth - 1];
 	ctm *= glm::frustum(left, right, bottom, top, zNear, zFar);
 }
 
 void MatrixStack::lookAt(const glm::vec3 &eye, const glm::vec3 &target, const glm::vec3 &up)
 {
-	glm::mat4 &top = stack.top();
+	glm::mat4 &top = stack[depth - 1];
 	top *= glm::lookAt(eye, target, up);
 }
 
 const glm::mat4 &MatrixStack::topMatrix() const
 {
-	return stack.top();
+	return stack[depth - 1];
 }
 
 void MatrixStack::print(const glm::mat4 &mat, const char *name)
@@ -124,5 +137,5 @@ void MatrixStack::print(const glm::mat4 &mat, const char *name)
 
 void MatrixStack::print(const char *name) const
 {
-	print(stack.top(), name);
+	print(stack[depth - 1], name);
 }
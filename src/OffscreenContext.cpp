@@ -0,0 +1,186 @@
+#include "OffscreenContext.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef FLUID_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+using namespace std;
+
+#ifdef FLUID_EGL
+
+namespace {
+
+// The surfaceless platform needs no X server or GPU device; plain
+// eglGetDisplay is the fallback for drivers without it
+EGLDisplay openDisplay()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (display != EGL_NO_DISPLAY) {
+			return display;
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+}
+
+bool OffscreenContext::init(int width, int height)
+{
+	shutdown();
+
+	EGLDisplay eglDisplay = openDisplay();
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		cerr << "Could not open an EGL display" << endl;
+		return false;
+	}
+	display = eglDisplay;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		cerr << "EGL has no desktop OpenGL" << endl;
+		shutdown();
+		return false;
+	}
+
+	// No surface is ever created, so any surface type will do
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs < 1) {
+		cerr << "No EGL config for OpenGL" << endl;
+		shutdown();
+		return false;
+	}
+
+	// The same version and profile WindowManager asks GLFW for
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT) {
+		cerr << "Could not create an OpenGL 3.2 context (EGL error 0x" << hex << eglGetError() << dec << ")" << endl;
+		shutdown();
+		return false;
+	}
+	context = eglContext;
+
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		cerr << "EGL has no surfaceless contexts" << endl;
+		shutdown();
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		cerr << "Failed to initialize GLAD" << endl;
+		shutdown();
+		return false;
+	}
+	glLoaded = true;
+
+	cout << "OpenGL version: " << glGetString(GL_VERSION) << endl;
+	cout << "Renderer: " << glGetString(GL_RENDERER) << endl;
+
+	this->width = width;
+	this->height = height;
+
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Offscreen framebuffer is incomplete" << endl;
+		shutdown();
+		return false;
+	}
+
+	pixels.resize((size_t)width * height * 4);
+	return true;
+}
+
+void OffscreenContext::shutdown()
+{
+	if (context) {
+		// GL calls go through GLAD, so there is nothing to delete until it
+		// has loaded for this context
+		if (glLoaded) {
+			if (framebuffer) {
+				glDeleteFramebuffers(1, &framebuffer);
+			}
+			if (colorBuffer) {
+				glDeleteRenderbuffers(1, &colorBuffer);
+			}
+			if (depthBuffer) {
+				glDeleteRenderbuffers(1, &depthBuffer);
+			}
+		}
+		framebuffer = colorBuffer = depthBuffer = 0;
+		glLoaded = false;
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		context = nullptr;
+	}
+	if (display) {
+		eglTerminate((EGLDisplay)display);
+		display = nullptr;
+	}
+}
+
+#else
+
+bool OffscreenContext::init(int width, int height)
+{
+	cerr << "Offscreen rendering needs EGL, which this build was made without" << endl;
+	return false;
+}
+
+void OffscreenContext::shutdown()
+{
+}
+
+#endif
+
+bool OffscreenContext::saveFrame(const std::string &file)
+{
+	if (pixels.empty()) {
+		return false;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	// OpenGL's rows start at the bottom, PNG's at the top
+	size_t rowBytes = (size_t)width * 4;
+	for (int y = 0; y < height / 2; y++) {
+		swap_ranges(pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes,
+			pixels.begin() + (height - 1 - y) * rowBytes);
+	}
+	if (!stbi_write_png(file.c_str(), width, height, 4, pixels.data(), width * 4)) {
+		cerr << "Could not write " << file << endl;
+		return false;
+	}
+	return true;
+}
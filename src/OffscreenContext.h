@@ -0,0 +1,48 @@
+#pragma once
+#ifndef OFFSCREENCONTEXT_H
+#define OFFSCREENCONTEXT_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+// An OpenGL context with no window, for rendering frames on machines without
+// a display. Uses EGL's surfaceless platform (Mesa's software rasterizer is
+// enough) and renders into a framebuffer object of the given size, which
+// stays bound so the usual drawing code runs unchanged. Needs a build with
+// EGL found (FLUID_EGL); otherwise init() fails.
+class OffscreenContext
+{
+public:
+	OffscreenContext() {}
+	~OffscreenContext() { shutdown(); }
+
+	OffscreenContext(const OffscreenContext&) = delete;
+	OffscreenContext& operator= (const OffscreenContext&) = delete;
+
+	bool init(int width, int height);
+	void shutdown();
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// Reads the framebuffer back and writes it as a PNG
+	bool saveFrame(const std::string &file);
+
+private:
+	int width = 0;
+	int height = 0;
+
+	void *display = nullptr;
+	void *context = nullptr;
+	// Whether GLAD has loaded the GL functions for context
+	bool glLoaded = false;
+
+	GLuint framebuffer = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+
+	std::vector<unsigned char> pixels;
+};
+
+#endif
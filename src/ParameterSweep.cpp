@@ -0,0 +1,265 @@
+#include "ParameterSweep.h"
+#include "Simulation.h"
+#include "Scenario.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const float blowUpSpeed = 1000.0f;
+
+struct RunMetrics {
+    int particles = 0;
+    int stepsDone = 0;
+    double stepsPerSecond = 0;
+    float densityError = 0;
+    float kineticEnergy = 0;
+    bool blewUp = false;
+};
+
+// Applies a setting that is not a Simulation parameter. Returns false if the
+// name is not one either.
+bool applyRunSetting(SweepRun &run, const string &name, float value) {
+    if (name == "particles") run.particles = (int)value;
+    else if (name == "steps") run.steps = (int)value;
+    else if (name == "seed") run.seed = (unsigned int)value;
+    else if (Simulation::isParameter(name)) run.parameters.push_back(make_pair(name, value));
+    else return false;
+    return true;
+}
+
+// scenario is the sweep's scenario, or null if it names none, and
+// initialDrops its settled drops
+RunMetrics simulate(const SweepRun &run, const Scenario *scenario, const vector<WaterDrop> &initialDrops) {
+    Simulation sim(1);
+    if (scenario) {
+        scenario->initialize(sim, initialDrops);
+    } else {
+        sim.setupRandom(run.particles, run.seed);
+    }
+    for (const pair<string, float> &parameter : run.parameters) {
+        sim.setParameter(parameter.first, parameter.second);
+    }
+
+    RunMetrics metrics;
+    metrics.particles = sim.water.size();
+    auto start = chrono::high_resolution_clock::now();
+    for (int step = 0; step < run.steps && !metrics.blewUp; step++) {
+        sim.step(0.016f); // 60 fps
+        metrics.stepsDone++;
+
+        for (const WaterDrop &drop : sim.water) {
+            float speed = length(drop.velocity);
+            if (!std::isfinite(speed) || !std::isfinite(drop.position.x) || !std::isfinite(drop.position.y) ||
+                speed > blowUpSpeed) {
+                metrics.blewUp = true;
+                break;
+            }
+        }
+    }
+    metrics.stepsPerSecond = metrics.stepsDone / chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+    metrics.densityError = sim.densityError();
+    metrics.kineticEnergy = sim.kineticEnergy();
+    return metrics;
+}
+
+// Streams results as the runs finish, in whatever order that is
+class MetricsWriter {
+public:
+    MetricsWriter(const string &fileName) : out(fileName), json(fileName.size() >= 5 && fileName.substr(fileName.size() - 5) == ".json") {
+        if (json) out << "[" << endl;
+        else out << "run,parameters,particles,steps,steps_done,steps_per_second,density_error,kinetic_energy,blew_up" << endl;
+    }
+
+    ~MetricsWriter() {
+        if (json) out << endl << "]" << endl;
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    void write(int index, const SweepRun &run, const RunMetrics &metrics, int total) {
+        lock_guard<mutex> guard(lock);
+        cout << "Run " << index << " done (" << ++finished << "/" << total << ")"
+             << (metrics.blewUp ? ", blew up" : "") << endl;
+
+        if (json) {
+            out << (rows++ ? ",\n" : "") << "  {\"run\": " << index << ", \"parameters\": {";
+            for (size_t p = 0; p < run.parameters.size(); p++) {
+                out << (p ? ", " : "") << "\"" << run.parameters[p].first << "\": " << run.parameters[p].second;
+            }
+            out << "}, \"particles\": " << metrics.particles << ", \"steps\": " << run.steps
+                << ", \"steps_done\": " << metrics.stepsDone << ", \"steps_per_second\": " << metrics.stepsPerSecond
+                << ", \"density_error\": " << finite(metrics.densityError)
+                << ", \"kinetic_energy\": " << finite(metrics.kineticEnergy)
+                << ", \"blew_up\": " << (metrics.blewUp ? "true" : "false") << "}";
+        } else {
+            out << index << ",";
+            for (size_t p = 0; p < run.parameters.size(); p++) {
+                out << (p ? " " : "") << run.parameters[p].first << "=" << run.parameters[p].second;
+            }
+            out << "," << metrics.particles << "," << run.steps << "," << metrics.stepsDone << ","
+                << metrics.stepsPerSecond << "," << metrics.densityError << "," << metrics.kineticEnergy << ","
+                << metrics.blewUp << "\n";
+        }
+        out.flush();
+    }
+
+private:
+    // JSON has no NaN or infinity
+    static string finite(float value) {
+        if (std::isfinite(value)) {
+            ostringstream text;
+            text << value;
+            return text.str();
+        }
+        return "null";
+    }
+
+    ofstream out;
+    bool json;
+    int rows = 0;
+    int finished = 0;
+    mutex lock;
+};
+
+} // namespace
+
+bool readSweep(const string &fileName, vector<SweepRun> &runs) {
+    ifstream file(fileName);
+    if (!file.is_open()) {
+        cerr << "Could not open file: '" << fileName << "'" << endl;
+        return false;
+    }
+
+    vector<pair<string, vector<float>>> axes;
+    vector<string> runLines;
+    string scenario;
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        if (line.compare(0, 4, "run ") == 0) {
+            runLines.push_back(line.substr(4));
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == string::npos) {
+            cerr << fileName << ":" << lineNumber << ": expected name = values" << endl;
+            return false;
+        }
+        if (trim(line.substr(0, equals)) == "scenario") {
+            scenario = trim(line.substr(equals + 1));
+            continue;
+        }
+        vector<float> values;
+        stringstream list(line.substr(equals + 1));
+        string value;
+        while (getline(list, value, ',')) {
+            values.push_back(stof(trim(value)));
+        }
+        axes.push_back(make_pair(trim(line.substr(0, equals)), values));
+    }
+
+    // Expand the grid, last axis fastest. With run lines only single values
+    // are used as their base.
+    runs.assign(1, SweepRun());
+    runs[0].scenario = scenario;
+    for (const pair<string, vector<float>> &axis : axes) {
+        if (!runLines.empty() && axis.second.size() != 1) {
+            cerr << fileName << ": " << axis.first << " lists several values next to run lines" << endl;
+            return false;
+        }
+        vector<SweepRun> expanded;
+        for (const SweepRun &run : runs) {
+            for (float value : axis.second) {
+                SweepRun next = run;
+                if (!applyRunSetting(next, axis.first, value)) {
+                    cerr << fileName << ": unknown parameter " << axis.first << endl;
+                    return false;
+                }
+                expanded.push_back(next);
+            }
+        }
+        runs.swap(expanded);
+    }
+
+    if (!runLines.empty()) {
+        SweepRun base = runs[0];
+        runs.clear();
+        for (const string &runLine : runLines) {
+            SweepRun run = base;
+            stringstream settings(runLine);
+            string setting;
+            while (settings >> setting) {
+                size_t equals = setting.find('=');
+                if (equals == string::npos || !applyRunSetting(run, setting.substr(0, equals), stof(setting.substr(equals + 1)))) {
+                    cerr << fileName << ": bad setting '" << setting << "'" << endl;
+                    return false;
+                }
+            }
+            runs.push_back(run);
+        }
+    }
+    return true;
+}
+
+int runSweep(const string &sweepFile, const string &outputFile) {
+    vector<SweepRun> runs;
+    try {
+        if (!readSweep(sweepFile, runs)) return 1;
+    } catch (const logic_error &) {
+        cerr << sweepFile << ": values must be numbers" << endl;
+        return 1;
+    }
+
+    // Every run starts from the sweep's scenario, so it is read, generated
+    // and settled (or taken from the cache) once here rather than by each run
+    Scenario scenario;
+    vector<WaterDrop> initialDrops;
+    bool hasScenario = !runs.empty() && !runs[0].scenario.empty();
+    if (hasScenario) {
+        if (!scenario.load(runs[0].scenario)) return 1;
+        Simulation initial(1);
+        scenario.initialize(initial);
+        initialDrops = initial.water;
+    }
+
+    MetricsWriter writer(outputFile);
+    if (!writer.isOpen()) {
+        cerr << "Could not open file: '" << outputFile << "'" << endl;
+        return 1;
+    }
+
+    int numThreads = std::max(1, std::min((int)thread::hardware_concurrency(), (int)runs.size()));
+    cout << "Sweeping " << runs.size() << " runs on " << numThreads << " threads" << endl;
+
+    atomic<int> next(0);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&] {
+            for (int index = next++; index < (int)runs.size(); index = next++) {
+                RunMetrics metrics = simulate(runs[index], hasScenario ? &scenario : nullptr, initialDrops);
+                writer.write(index, runs[index], metrics, (int)runs.size());
+            }
+        });
+    }
+    for (thread &t : threads) {
+        t.join();
+    }
+    return 0;
+}
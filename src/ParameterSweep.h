@@ -0,0 +1,37 @@
+#ifndef PARAMETERSWEEP_H
+#define PARAMETERSWEEP_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// One headless run of a sweep: Simulation parameters by name plus the
+// run's own settings
+struct SweepRun {
+    std::vector<std::pair<std::string, float>> parameters;
+    int particles = 2000;
+    int steps = 600;
+    unsigned int seed = 1;
+    // Scenario file for the initial state instead of particles and seed
+    std::string scenario;
+};
+
+// Reads a sweep description. Lines are "name = value, value, ..." and every
+// combination of the listed values becomes a run, unless the file has
+// "run name=value name=value ..." lines, in which case each of those is one
+// run on top of the single-valued settings. particles, steps and seed are
+// accepted next to the Simulation parameters, as is "scenario = file" to start
+// every run from that scenario's (cached) initial state with the sweep's
+// parameters applied on top; # starts a comment. Prints the
+// problem and returns false on a malformed file.
+bool readSweep(const std::string &fileName, std::vector<SweepRun> &runs);
+
+// Runs every run as an independent single-threaded simulation, as many at
+// once as there are cores, and streams one line of metrics per finished run
+// to outputFile: JSON if it ends in .json, CSV otherwise. Metrics are steps
+// per second, mean relative density error, kinetic energy and whether and
+// when the run blew up (non-finite or faster than 1000 units/s). Fails
+// without running anything if the sweep or its scenario cannot be read.
+int runSweep(const std::string &sweepFile, const std::string &outputFile);
+
+#endif // PARAMETERSWEEP_H
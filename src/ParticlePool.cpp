@@ -0,0 +1,54 @@
+#include "ParticlePool.h"
+
+#include <cassert>
+
+using namespace std;
+
+void ParticlePool::reserve(int capacity, HeapCounter &counter) {
+    if (capacity <= maxParticles) return;
+    reserveBuffer(ids, capacity, counter);
+    reserveBuffer(freeIds, capacity, counter);
+    reserveBuffer(indices, capacity, counter);
+
+    // New ids go below the existing free ones so low ids are reused first
+    freeIds.insert(freeIds.begin(), capacity - maxParticles, 0);
+    for (int id = maxParticles; id < capacity; id++) {
+        freeIds[capacity - 1 - id] = id;
+    }
+    indices.resize(capacity, -1);
+    maxParticles = capacity;
+}
+
+void ParticlePool::reset(int count) {
+    assert(count <= maxParticles);
+    ids.resize(count);
+    freeIds.clear();
+    for (int id = maxParticles - 1; id >= 0; id--) {
+        if (id < count) {
+            ids[id] = id;
+            indices[id] = id;
+        } else {
+            indices[id] = -1;
+            freeIds.push_back(id);
+        }
+    }
+}
+
+int ParticlePool::acquire() {
+    if (freeIds.empty()) return -1;
+    int id = freeIds.back();
+    freeIds.pop_back();
+    indices[id] = (int)ids.size();
+    ids.push_back(id);
+    return id;
+}
+
+void ParticlePool::release(int index) {
+    int id = ids[index];
+    int last = ids.back();
+    ids[index] = last;
+    indices[last] = index;
+    ids.pop_back();
+    indices[id] = -1;
+    freeIds.push_back(id);
+}
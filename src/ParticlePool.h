@@ -0,0 +1,38 @@
+#ifndef PARTICLEPOOL_H
+#define PARTICLEPOOL_H
+
+#include <vector>
+
+#include "FrameArena.h"
+
+// Stable ids for a packed particle array. Releasing a particle moves the
+// last one into its index (swap-remove) so live particles stay contiguous,
+// while ids stay with their particle and freed ids are reused from a free
+// list. Storage is reserved up front; acquire() fails instead of growing.
+class ParticlePool {
+public:
+    // Makes room for capacity particles, keeping the current ones
+    void reserve(int capacity, HeapCounter &counter);
+    // Forgets every particle and gives ids 0..count-1 to count new ones
+    void reset(int count);
+
+    int size() const { return (int)ids.size(); }
+    int capacity() const { return maxParticles; }
+
+    // Id for a particle appended at index size(), or -1 when full
+    int acquire();
+    // Frees the particle at index and moves the last particle into it
+    void release(int index);
+
+    int idAt(int index) const { return ids[index]; }
+    // -1 for a free id
+    int indexOf(int id) const { return indices[id]; }
+
+private:
+    int maxParticles = 0;
+    std::vector<int> ids;      // by index
+    std::vector<int> indices;  // by id
+    std::vector<int> freeIds;
+};
+
+#endif // PARTICLEPOOL_H
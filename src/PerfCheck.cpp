@@ -0,0 +1,247 @@
+#include "PerfCheck.h"
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const double defaultTolerance = 0.15;
+
+// The scene and what was measured on it. "step" is the whole step.
+struct Baseline {
+    int drops = 4000;
+    int threads = 1;
+    int steps = 60;
+    int repeats = 5;
+    // Time differences under this many milliseconds are noise
+    double noiseFloorMs = 0.05;
+
+    struct Metric {
+        double ms = 0;
+        double msTolerance = defaultTolerance;
+        long allocations = 0;
+        long allocationsTolerance = 0;
+    };
+    map<string, Metric> phases;
+};
+
+// Reads the flat subset of JSON the baseline uses, objects of numbers,
+// into dotted keys like "phases.density.ms"
+class JsonReader {
+public:
+    explicit JsonReader(const string &text) : text(text) {}
+
+    bool read(map<string, double> &values) {
+        return parseObject("", values) && (skipSpace(), position == text.size());
+    }
+
+private:
+    const string &text;
+    size_t position = 0;
+
+    void skipSpace() {
+        while (position < text.size() && isspace((unsigned char)text[position])) position++;
+    }
+
+    bool expect(char c) {
+        skipSpace();
+        if (position >= text.size() || text[position] != c) return false;
+        position++;
+        return true;
+    }
+
+    bool parseString(string &value) {
+        if (!expect('"')) return false;
+        size_t end = text.find('"', position);
+        if (end == string::npos) return false;
+        value = text.substr(position, end - position);
+        position = end + 1;
+        return true;
+    }
+
+    bool parseObject(const string &prefix, map<string, double> &values) {
+        if (!expect('{')) return false;
+        skipSpace();
+        if (position < text.size() && text[position] == '}') return expect('}');
+        do {
+            string key;
+            if (!parseString(key) || !expect(':')) return false;
+            string name = prefix.empty() ? key : prefix + "." + key;
+            skipSpace();
+            if (position < text.size() && text[position] == '{') {
+                if (!parseObject(name, values)) return false;
+            } else {
+                const char *start = text.c_str() + position;
+                char *end;
+                double number = strtod(start, &end);
+                if (end == start) return false;
+                position += end - start;
+                values[name] = number;
+            }
+        } while (expect(','));
+        return expect('}');
+    }
+};
+
+bool loadBaseline(const string &file, Baseline &baseline) {
+    ifstream in(file);
+    if (!in) return false;
+    stringstream contents;
+    contents << in.rdbuf();
+    string text = contents.str();
+
+    map<string, double> values;
+    if (!JsonReader(text).read(values)) {
+        cerr << file << ": not a baseline JSON file" << endl;
+        return false;
+    }
+    for (const pair<const string, double> &value : values) {
+        const string &key = value.first;
+        if (key == "drops") baseline.drops = (int)value.second;
+        else if (key == "threads") baseline.threads = (int)value.second;
+        else if (key == "steps") baseline.steps = (int)value.second;
+        else if (key == "repeats") baseline.repeats = (int)value.second;
+        else if (key == "noise_floor_ms") baseline.noiseFloorMs = value.second;
+        else if (key.compare(0, 7, "phases.") == 0 && key.rfind('.') > 7) {
+            string phase = key.substr(7, key.rfind('.') - 7);
+            string field = key.substr(key.rfind('.') + 1);
+            Baseline::Metric &metric = baseline.phases[phase];
+            if (field == "ms") metric.ms = value.second;
+            else if (field == "ms_tolerance") metric.msTolerance = value.second;
+            else if (field == "allocations") metric.allocations = (long)value.second;
+            else if (field == "allocations_tolerance") metric.allocationsTolerance = (long)value.second;
+            else cerr << file << ": unknown field " << key << endl;
+        } else {
+            cerr << file << ": unknown field " << key << endl;
+        }
+    }
+    if (baseline.drops < 1 || baseline.threads < 1 || baseline.steps < 1 || baseline.repeats < 1) {
+        cerr << file << ": drops, threads, steps and repeats must be positive" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool saveBaseline(const string &file, const Baseline &baseline) {
+    ofstream out(file);
+    out << "{" << endl;
+    out << "    \"drops\": " << baseline.drops << "," << endl;
+    out << "    \"threads\": " << baseline.threads << "," << endl;
+    out << "    \"steps\": " << baseline.steps << "," << endl;
+    out << "    \"repeats\": " << baseline.repeats << "," << endl;
+    out << "    \"noise_floor_ms\": " << baseline.noiseFloorMs << "," << endl;
+    out << "    \"phases\": {" << endl;
+    size_t written = 0;
+    for (const pair<const string, Baseline::Metric> &phase : baseline.phases) {
+        const Baseline::Metric &metric = phase.second;
+        out << "        \"" << phase.first << "\": {\"ms\": " << fixed << setprecision(4) << metric.ms
+            << ", \"ms_tolerance\": " << setprecision(2) << metric.msTolerance
+            << ", \"allocations\": " << metric.allocations
+            << ", \"allocations_tolerance\": " << metric.allocationsTolerance << "}"
+            << (++written < baseline.phases.size() ? "," : "") << endl;
+    }
+    out << "    }" << endl;
+    out << "}" << endl;
+    if (!out) {
+        cerr << "Could not write " << file << endl;
+        return false;
+    }
+    return true;
+}
+
+// The fastest repeat's median time, and the most allocations in any step
+map<string, Baseline::Metric> measure(const Baseline &baseline) {
+    bool counting = allocationCountingEnabled();
+    map<string, Baseline::Metric> best;
+    for (int repeat = 0; repeat < baseline.repeats; repeat++) {
+        Simulation sim(baseline.threads);
+        warmUpSimulation(sim, baseline.drops);
+
+        vector<vector<double>> times(Simulation::NumPhases + 1, vector<double>(baseline.steps));
+        vector<long> allocations(Simulation::NumPhases + 1);
+        for (int i = 0; i < baseline.steps; i++) {
+            sim.step(benchmarkDeltaTime);
+            for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+                times[phase][i] = sim.getPhaseStats(phase).ms;
+                allocations[phase] = std::max(allocations[phase], sim.getPhaseStats(phase).heap.allocations);
+            }
+            times[Simulation::NumPhases][i] = sim.getStepStats().ms;
+            long stepAllocations = counting ? sim.getStepStats().heap.allocations : sim.stepAllocations().allocations;
+            allocations[Simulation::NumPhases] = std::max(allocations[Simulation::NumPhases], stepAllocations);
+        }
+
+        for (int phase = 0; phase <= Simulation::NumPhases; phase++) {
+            string name = phase < Simulation::NumPhases ? Simulation::phaseName(phase) : "step";
+            double ms = median(times[phase]);
+            if (repeat == 0 || ms < best[name].ms) best[name].ms = ms;
+            best[name].allocations = std::max(best[name].allocations, allocations[phase]);
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int runPerfCheck(const string &baselineFile, bool update) {
+    Baseline baseline;
+    bool loaded = loadBaseline(baselineFile, baseline);
+    if (!loaded && !update) {
+        cerr << "No baseline in " << baselineFile << ", create one with --update" << endl;
+        return 1;
+    }
+    if (!allocationCountingEnabled()) {
+        cerr << "Allocation counting is not compiled in (cmake -DFLUID_COUNT_ALLOCATIONS=ON),"
+             << " checking the step's own buffers only" << endl;
+    }
+
+    map<string, Baseline::Metric> current = measure(baseline);
+
+    if (update) {
+        for (const pair<const string, Baseline::Metric> &phase : current) {
+            Baseline::Metric &metric = baseline.phases[phase.first];
+            metric.ms = phase.second.ms;
+            metric.allocations = phase.second.allocations;
+        }
+        if (!saveBaseline(baselineFile, baseline)) return 1;
+        cout << "Updated " << baselineFile << endl;
+        return 0;
+    }
+
+    int regressions = 0;
+    cout << "phase,baseline_ms,ms,limit_ms,baseline_allocations,allocations,result" << endl;
+    for (const pair<const string, Baseline::Metric> &phase : baseline.phases) {
+        const Baseline::Metric &expected = phase.second;
+        if (!current.count(phase.first)) {
+            cerr << "Baseline phase " << phase.first << " was not measured" << endl;
+            regressions++;
+            continue;
+        }
+        const Baseline::Metric &measured = current[phase.first];
+        double limit = std::max(expected.ms * (1 + expected.msTolerance), expected.ms + baseline.noiseFloorMs);
+        bool slower = measured.ms > limit;
+        bool allocates = measured.allocations > expected.allocations + expected.allocationsTolerance;
+        regressions += slower || allocates;
+
+        cout << phase.first << "," << fixed << setprecision(3) << expected.ms << "," << measured.ms << "," << limit
+             << "," << expected.allocations << "," << measured.allocations << ","
+             << (slower ? (allocates ? "slower, allocates" : "slower") : (allocates ? "allocates" : "ok")) << endl;
+    }
+
+    if (regressions > 0) {
+        cerr << regressions << " phases regressed against " << baselineFile
+             << "; if that is intended, refresh it with --update" << endl;
+        return 1;
+    }
+    cout << "No regressions against " << baselineFile << endl;
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef PERFCHECK_H
+#define PERFCHECK_H
+
+#include <string>
+
+// Times each phase of the step on a fixed scene and compares it against a
+// baseline JSON file (bench/perf-baseline.json). Every repeat runs a fresh
+// simulation and takes the median over its steps; the fastest repeat counts,
+// which filters out most of the noise from other processes. A phase
+// regresses when its time is over the baseline by more than its tolerance
+// or its heap allocations go over the baseline's. Returns 1 on a regression.
+// With update set, writes the measurements as the new baseline instead,
+// keeping the scene and tolerances already in the file.
+int runPerfCheck(const std::string &baselineFile, bool update);
+
+#endif // PERFCHECK_H
@@ -0,0 +1,172 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+const char *PerfCount::counterName(int counter) {
+    static const char *names[NumCounters] = {"cycles", "instructions", "l1_misses", "llc_misses", "branch_misses"};
+    return names[counter];
+}
+
+PerfCount PerfCount::operator+(const PerfCount &other) const {
+    PerfCount sum;
+    for (int i = 0; i < NumCounters; i++) {
+        sum.values[i] = values[i] < 0 || other.values[i] < 0 ? -1 : values[i] + other.values[i];
+    }
+    return sum;
+}
+
+PerfCount PerfCount::operator-(const PerfCount &other) const {
+    PerfCount difference;
+    for (int i = 0; i < NumCounters; i++) {
+        difference.values[i] = values[i] < 0 || other.values[i] < 0 ? -1 : values[i] - other.values[i];
+    }
+    return difference;
+}
+
+#ifdef __linux__
+
+namespace {
+
+void describe(int counter, perf_event_attr &attr) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (counter) {
+    case PerfCount::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfCount::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfCount::L1Misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PerfCount::LLCMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PerfCount::BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+}
+
+int openEvent(perf_event_attr &attr, long threadId, int leader) {
+    return (int)syscall(SYS_perf_event_open, &attr, (pid_t)threadId, -1, leader, 0);
+}
+
+} // namespace
+
+bool PerfCounters::open(const vector<long> &threadIds) {
+    close();
+    error.clear();
+    if (threadIds.empty() || threadIds[0] == 0) {
+        error = "thread ids unknown";
+        return false;
+    }
+
+    // Find the counters this machine has on the first thread, then open the
+    // same set on the others so every group reads back the same layout
+    for (long threadId : threadIds) {
+        Group group;
+        for (int counter = 0; counter < PerfCount::NumCounters; counter++) {
+            bool first = groups.empty();
+            if (!first && !has(counter)) continue;
+
+            perf_event_attr attr;
+            describe(counter, attr);
+            int fd = openEvent(attr, threadId, group.fds.empty() ? -1 : group.fds[0]);
+            if (fd < 0) {
+                if (first) {
+                    if (error.empty()) error = string(PerfCount::counterName(counter)) + ": " + strerror(errno);
+                    continue;
+                }
+                // A counter the first thread had is missing here, so the
+                // layouts would disagree
+                error = string("thread ") + to_string(threadId) + ": " + strerror(errno);
+                for (int open : group.fds) ::close(open);
+                close();
+                return false;
+            }
+            group.fds.push_back(fd);
+            if (first) counters.push_back(counter);
+        }
+        if (group.fds.empty()) {
+            close();
+            return false;
+        }
+        groups.push_back(group);
+    }
+    return true;
+}
+
+void PerfCounters::close() {
+    for (Group &group : groups) {
+        for (int fd : group.fds) ::close(fd);
+    }
+    groups.clear();
+    counters.clear();
+}
+
+bool PerfCounters::has(int counter) const {
+    return std::find(counters.begin(), counters.end(), counter) != counters.end();
+}
+
+PerfCount PerfCounters::read() const {
+    PerfCount total;
+    for (int counter = 0; counter < PerfCount::NumCounters; counter++) {
+        total.values[counter] = has(counter) ? 0 : -1;
+    }
+
+    // nr, time enabled, time running, then one value per counter
+    uint64_t buffer[3 + PerfCount::NumCounters];
+    for (const Group &group : groups) {
+        ssize_t size = ::read(group.fds[0], buffer, sizeof(buffer));
+        if (size < (ssize_t)(3 * sizeof(uint64_t)) || buffer[0] != counters.size()) continue;
+        double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 0;
+        for (size_t slot = 0; slot < counters.size(); slot++) {
+            total.values[counters[slot]] += (long long)(buffer[3 + slot] * scale);
+        }
+    }
+    return total;
+}
+
+#else
+
+bool PerfCounters::open(const vector<long> &) {
+    error = "hardware counters need Linux";
+    return false;
+}
+
+void PerfCounters::close() {
+}
+
+bool PerfCounters::has(int) const {
+    return false;
+}
+
+PerfCount PerfCounters::read() const {
+    PerfCount total;
+    for (long long &value : total.values) value = -1;
+    return total;
+}
+
+#endif
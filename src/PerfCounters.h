@@ -0,0 +1,57 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <string>
+#include <vector>
+
+// Hardware event totals. A counter the machine could not provide is -1.
+struct PerfCount {
+    enum Counter { Cycles, Instructions, L1Misses, LLCMisses, BranchMisses, NumCounters };
+    long long values[NumCounters];
+
+    PerfCount() {
+        for (long long &value : values) value = 0;
+    }
+    static const char *counterName(int counter);
+
+    PerfCount operator+(const PerfCount &other) const;
+    PerfCount operator-(const PerfCount &other) const;
+};
+
+// Hardware counters read with perf_event_open, one event group per thread.
+// Only user-space events are counted, which perf_event_paranoid up to 2
+// allows. Counters the kernel refuses, e.g. in a container or a VM without a
+// PMU, are left out and read as -1; if none open the counters stay closed
+// and read() returns all -1. Linux only.
+class PerfCounters {
+public:
+    PerfCounters() {}
+    ~PerfCounters() { close(); }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Attaches to the given kernel thread ids. Returns whether any counter
+    // opened; otherwise getError() says why.
+    bool open(const std::vector<long> &threadIds);
+    void close();
+
+    bool isOpen() const { return !groups.empty(); }
+    const std::string &getError() const { return error; }
+    bool has(int counter) const;
+
+    // Totals over all the threads since open(), scaled up where the kernel
+    // had to multiplex the counters
+    PerfCount read() const;
+
+private:
+    struct Group {
+        std::vector<int> fds;   // the first leads the group
+    };
+    std::vector<Group> groups;
+    // Which counter each slot of a group read holds, the same for every group
+    std::vector<int> counters;
+    std::string error;
+};
+
+#endif // PERFCOUNTERS_H
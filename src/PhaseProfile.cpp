@@ -0,0 +1,63 @@
+#include "PhaseProfile.h"
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Per step average, or empty when the counter is missing
+void printEvents(const Simulation &sim, const PerfCount &events, int counter, int steps) {
+    cout << ",";
+    if (sim.counters && sim.counters->has(counter)) cout << events.values[counter] / steps;
+}
+
+} // namespace
+
+int runPhaseProfile(int numWaterDrops, int steps) {
+    Simulation sim;
+    warmUpSimulation(sim, numWaterDrops);
+
+    string error;
+    if (!sim.openCounters(error)) {
+        cerr << "No hardware counters (" << error << "), reporting time and allocations only" << endl;
+    } else if (!error.empty()) {
+        cerr << "Some hardware counters are missing (" << error << ")" << endl;
+    }
+
+    Simulation::PhaseStats totals[Simulation::NumPhases];
+    for (int i = 0; i < steps; i++) {
+        sim.step(benchmarkDeltaTime);
+        for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+            const Simulation::PhaseStats &stats = sim.getPhaseStats(phase);
+            totals[phase].ms += stats.ms;
+            totals[phase].heap = totals[phase].heap + stats.heap;
+            totals[phase].events = totals[phase].events + stats.events;
+        }
+    }
+
+    cout << "phase,ms,allocations";
+    for (int counter = 0; counter < PerfCount::NumCounters; counter++) {
+        cout << "," << PerfCount::counterName(counter);
+    }
+    cout << ",ipc" << endl;
+    for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+        const Simulation::PhaseStats &total = totals[phase];
+        cout << Simulation::phaseName(phase) << "," << fixed << setprecision(3) << total.ms / steps << ","
+             << (double)total.heap.allocations / steps;
+        for (int counter = 0; counter < PerfCount::NumCounters; counter++) {
+            printEvents(sim, total.events, counter, steps);
+        }
+        cout << ",";
+        long long cycles = total.events.values[PerfCount::Cycles];
+        long long instructions = total.events.values[PerfCount::Instructions];
+        if (sim.counters && sim.counters->has(PerfCount::Instructions) && cycles > 0) {
+            cout << (double)instructions / cycles;
+        }
+        cout << endl;
+    }
+    return 0;
+}
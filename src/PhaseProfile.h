@@ -0,0 +1,10 @@
+#ifndef PHASEPROFILE_H
+#define PHASEPROFILE_H
+
+// Warms a simulation of numWaterDrops up, then runs it for steps more and
+// prints a CSV row per phase of the step: time, heap allocations and, where
+// the machine has them, hardware counters, all averaged per step. Needs no
+// window.
+int runPhaseProfile(int numWaterDrops, int steps = 300);
+
+#endif // PHASEPROFILE_H
@@ -97,22 +97,59 @@ bool Program::init()
 
 void Program::bind()
 {
-	CHECKED_GL_CALL(glUseProgram(pid));
+	CHECKED_GL_CALL(GLSL::useProgram(pid));
 }
 
 void Program::unbind()
 {
-	CHECKED_GL_CALL(glUseProgram(0));
+	CHECKED_GL_CALL(GLSL::useProgram(0));
 }
 
-void Program::addAttribute(const std::string &name)
+Program::Attribute Program::addAttribute(const std::string &name)
 {
-	attributes[name] = GLSL::getAttribLocation(pid, name.c_str(), isVerbose());
+	Attribute attribute;
+	attribute.location = GLSL::getAttribLocation(pid, name.c_str(), isVerbose());
+	attributes[name] = attribute.location;
+	return attribute;
 }
 
-void Program::addUniform(const std::string &name)
+Program::Uniform Program::addUniform(const std::string &name)
 {
-	uniforms[name] = GLSL::getUniformLocation(pid, name.c_str(), isVerbose());
+	Uniform uniform;
+	uniform.location = GLSL::getUniformLocation(pid, name.c_str(), isVerbose());
+	uniforms[name] = uniform.location;
+	return uniform;
+}
+
+bool Program::addUniformBlock(const std::string &name, GLuint binding)
+{
+	GLuint index = glGetUniformBlockIndex(pid, name.c_str());
+	if (index == GL_INVALID_INDEX)
+	{
+		if (isVerbose())
+		{
+			std::cerr << "WARN: " << name << " is not a uniform block" << std::endl;
+		}
+		return false;
+	}
+	CHECKED_GL_CALL(glUniformBlockBinding(pid, index, binding));
+	return true;
+}
+
+void Program::setUniform(Uniform uniform, float value) const
+{
+	if (uniform.location >= 0)
+	{
+		glUniform1f(uniform.location, value);
+	}
+}
+
+void Program::setUniform(Uniform uniform, const glm::mat4 &value) const
+{
+	if (uniform.location >= 0)
+	{
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &value[0][0]);
+	}
 }
 
 GLint Program::getAttribute(const std::string &name) const
@@ -8,6 +8,7 @@
 #include <string>
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 
 std::string readFileAsString(const std::string &fileName);
@@ -25,11 +26,26 @@ public:
 	virtual void bind();
 	virtual void unbind();
 
-	void addAttribute(const std::string &name);
-	void addUniform(const std::string &name);
+	// Locations looked up once after init(), so draws need no name lookups.
+	// A handle to a variable the shader lacks is -1 and ignored by setUniform.
+	struct Attribute { GLint location = -1; };
+	struct Uniform { GLint location = -1; };
+
+	Attribute addAttribute(const std::string &name);
+	Uniform addUniform(const std::string &name);
+
+	// Points the named std140 uniform block at a UniformBuffer binding
+	bool addUniformBlock(const std::string &name, GLuint binding);
+
+	// Lookups by name, for code that does not keep the handles
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
 
+	void setUniform(Uniform uniform, float value) const;
+	void setUniform(Uniform uniform, const glm::mat4 &value) const;
+
+	GLuint getPID() const { return pid; }
+
 protected:
 
 	std::string vShaderName;
@@ -0,0 +1,109 @@
+#include "ScalingStudy.h"
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const int warmupSteps = 10;
+
+// Median times of one run; phases[NumPhases] is what the step spent
+// outside the phases
+struct RunTimes {
+    double stepMs = 0;
+    double phaseMs[Simulation::NumPhases + 1] = {};
+};
+
+RunTimes timeRun(int threads, int drops, float boxScale, int steps) {
+    Simulation sim(threads);
+    sim.width *= boxScale;
+    sim.height *= boxScale;
+    warmUpSimulation(sim, drops, warmupSteps);
+
+    vector<vector<double>> samples(Simulation::NumPhases + 2, vector<double>(steps));
+    for (int i = 0; i < steps; i++) {
+        auto start = chrono::high_resolution_clock::now();
+        sim.step(benchmarkDeltaTime);
+        double stepMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+        samples[0][i] = stepMs;
+        for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+            samples[phase + 1][i] = sim.getPhaseStats(phase).ms;
+        }
+        samples[Simulation::NumPhases + 1][i] = std::max(0.0, stepMs - sim.getStepStats().ms);
+    }
+
+    RunTimes times;
+    times.stepMs = median(samples[0]);
+    for (int phase = 0; phase <= Simulation::NumPhases; phase++) {
+        times.phaseMs[phase] = median(samples[phase + 1]);
+    }
+    return times;
+}
+
+double speedupOf(double numerator, double denominator) {
+    return denominator > 0 ? numerator / denominator : 0;
+}
+
+} // namespace
+
+int runScalingStudy(int maxThreads, int dropsPerThread, int steps, const string &outputFile) {
+    if (maxThreads < 1 || dropsPerThread < 1 || steps < 1) {
+        cerr << "Threads, drops per thread and steps must be positive" << endl;
+        return 1;
+    }
+
+    ofstream file;
+    if (!outputFile.empty()) {
+        file.open(outputFile);
+        if (!file) {
+            cerr << "Could not write " << outputFile << endl;
+            return 1;
+        }
+    }
+    ostream &out = outputFile.empty() ? cout : file;
+
+    vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    out << "mode,threads,drops,step_ms,speedup,efficiency";
+    for (int phase = 0; phase <= Simulation::NumPhases; phase++) {
+        const char *name = phase < Simulation::NumPhases ? Simulation::phaseName(phase) : "other";
+        out << "," << name << "_ms," << name << "_speedup";
+    }
+    out << endl;
+
+    for (int weak = 0; weak < 2; weak++) {
+        RunTimes single;
+        for (int threads : threadCounts) {
+            int drops = weak ? dropsPerThread * threads : dropsPerThread * maxThreads;
+            float boxScale = weak ? sqrt((float)threads) : sqrt((float)maxThreads);
+            cerr << (weak ? "Weak" : "Strong") << " scaling: " << threads << " threads, " << drops << " drops" << endl;
+            RunTimes times = timeRun(threads, drops, boxScale, steps);
+            if (threads == 1) single = times;
+
+            // Weak scaling does threads times the work, so ideal is flat time
+            double work = weak ? threads : 1;
+            double speedup = speedupOf(single.stepMs * work, times.stepMs);
+            out << (weak ? "weak" : "strong") << "," << threads << "," << drops << "," << fixed << setprecision(3)
+                << times.stepMs << "," << speedup << "," << speedup / threads;
+            for (int phase = 0; phase <= Simulation::NumPhases; phase++) {
+                out << "," << times.phaseMs[phase] << "," << speedupOf(single.phaseMs[phase] * work, times.phaseMs[phase]);
+            }
+            out << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef SCALINGSTUDY_H
+#define SCALINGSTUDY_H
+
+#include <string>
+
+// Times the step on 1, 2, 4, ... up to maxThreads threads and writes a CSV
+// row per run to outputFile, or stdout if it is empty. Strong scaling keeps
+// dropsPerThread * maxThreads drops for every thread count; weak scaling
+// gives each thread dropsPerThread drops and grows the box with them so the
+// fluid stays as dense. Each row has the median step time, speedup and
+// parallel efficiency against one thread, and the same for every phase.
+int runScalingStudy(int maxThreads, int dropsPerThread, int steps, const std::string &outputFile);
+
+#endif // SCALINGSTUDY_H
@@ -0,0 +1,406 @@
+#include "Scenario.h"
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Bump when generation or the cache layout changes
+const uint32_t cacheVersion = 2;
+const char cacheMagic[4] = {'F', 'S', 'I', 'S'};
+
+bool readNumbers(const string &text, float *out, int count) {
+    stringstream values(text);
+    for (int i = 0; i < count; i++) {
+        if (!(values >> out[i])) return false;
+    }
+    string rest;
+    return !(values >> rest);
+}
+
+// FNV-1a
+void hashBytes(uint64_t &hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+template <typename T>
+void hashValue(uint64_t &hash, const T &value) {
+    hashBytes(hash, &value, sizeof(value));
+}
+
+// Cached drops, after the header: radius, position and velocity
+struct CachedDrop {
+    float radius;
+    float x, y;
+    float vx, vy;
+};
+
+} // namespace
+
+bool Scenario::load(const string &fileName) {
+    ifstream file(fileName);
+    if (!file.is_open()) {
+        cerr << "Could not open file: '" << fileName << "'" << endl;
+        return false;
+    }
+
+    string section;
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        if (line[0] == '[') {
+            section = trim(line.substr(1, line.find(']') - 1));
+            if (section == "block") blocks.push_back(FluidBlock());
+            else if (section == "emitter") emitters.push_back(Emitter());
+            else if (section == "sink") sinks.push_back(Sink());
+            else if (section == "obstacle") obstacles.push_back(ObstacleShape());
+            else if (section != "domain" && section != "parameters" && section != "run" && section != "output") {
+                cerr << fileName << ":" << lineNumber << ": unknown section [" << section << "]" << endl;
+                return false;
+            }
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == string::npos || section.empty()) {
+            cerr << fileName << ":" << lineNumber << ": expected name = value inside a section" << endl;
+            return false;
+        }
+        string key = trim(line.substr(0, equals));
+        string value = trim(line.substr(equals + 1));
+
+        // Numeric settings take one number, vector ones two
+        float v[2] = {0, 0};
+        bool number = readNumbers(value, v, 1);
+        bool vector = readNumbers(value, v, 2);
+        bool ok = number;
+        bool known = true;
+        if (section == "domain") {
+            if (key == "width") width = v[0];
+            else if (key == "height") height = v[0];
+            else known = false;
+        } else if (section == "parameters") {
+            known = Simulation::isParameter(key);
+            parameters.push_back(make_pair(key, v[0]));
+        } else if (section == "block") {
+            FluidBlock &block = blocks.back();
+            if (key == "min" || key == "max" || key == "velocity") {
+                ok = vector;
+                vec2 &target = key == "min" ? block.min : key == "max" ? block.max : block.velocity;
+                target = vec2(v[0], v[1]);
+            }
+            else if (key == "spacing") block.spacing = v[0];
+            else if (key == "jitter") block.jitter = v[0];
+            else if (key == "radius") block.radius = v[0];
+            else if (key == "seed") block.seed = (unsigned int)v[0];
+            else known = false;
+        } else if (section == "emitter") {
+            Emitter &emitter = emitters.back();
+            if (key == "position" || key == "velocity") {
+                ok = vector;
+                (key == "position" ? emitter.position : emitter.velocity) = vec2(v[0], v[1]);
+            }
+            else if (key == "rate") emitter.rate = v[0];
+            else if (key == "spread") emitter.spread = v[0];
+            else if (key == "radius") emitter.radius = v[0];
+            else known = false;
+        } else if (section == "sink") {
+            Sink &sink = sinks.back();
+            ok = vector;
+            if (key == "min") sink.min = vec2(v[0], v[1]);
+            else if (key == "max") sink.max = vec2(v[0], v[1]);
+            else known = false;
+        } else if (section == "obstacle") {
+            ObstacleShape &obstacle = obstacles.back();
+            if (key == "type") {
+                obstacle.type = value;
+                ok = value == "circle" || value == "capsule" || value == "box";
+            } else if (key == "radius") {
+                obstacle.radius = v[0];
+            } else {
+                ok = vector;
+                if (key == "center") obstacle.center = vec2(v[0], v[1]);
+                else if (key == "a") obstacle.a = vec2(v[0], v[1]);
+                else if (key == "b") obstacle.b = vec2(v[0], v[1]);
+                else if (key == "size") obstacle.size = vec2(v[0], v[1]);
+                else known = false;
+            }
+        } else if (section == "run") {
+            if (key == "steps") steps = (int)v[0];
+            else if (key == "settle") settleSteps = (int)v[0];
+            else if (key == "dt") timeStep = v[0];
+            else if (key == "threads") threads = (int)v[0];
+            else if (key == "capacity") capacity = (int)v[0];
+            else known = false;
+        } else {
+            if (key == "metrics") {
+                ok = true;
+                metricsFile = value;
+            }
+            else if (key == "interval") metricsInterval = (int)v[0];
+            else if (key == "trajectory") {
+                ok = true;
+                trajectoryFile = value;
+            }
+            else if (key == "trajectoryInterval") trajectoryInterval = (int)v[0];
+            else known = false;
+        }
+
+        if (!known) {
+            cerr << fileName << ":" << lineNumber << ": unknown setting " << key << " in [" << section << "]" << endl;
+            return false;
+        }
+        if (!ok || (section == "block" && blocks.back().spacing <= 0) || metricsInterval < 1 || trajectoryInterval < 1) {
+            cerr << fileName << ":" << lineNumber << ": bad value for " << key << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t Scenario::initialStateHash() const {
+    uint64_t hash = 14695981039346656037ull;
+    hashValue(hash, cacheVersion);
+    hashValue(hash, width);
+    hashValue(hash, height);
+    for (const pair<string, float> &parameter : parameters) {
+        hashBytes(hash, parameter.first.data(), parameter.first.size() + 1);
+        hashValue(hash, parameter.second);
+    }
+    for (const FluidBlock &block : blocks) {
+        hashValue(hash, block.min);
+        hashValue(hash, block.max);
+        hashValue(hash, block.spacing);
+        hashValue(hash, block.jitter);
+        hashValue(hash, block.radius);
+        hashValue(hash, block.velocity);
+        hashValue(hash, block.seed);
+    }
+    for (const ObstacleShape &obstacle : obstacles) {
+        hashBytes(hash, obstacle.type.data(), obstacle.type.size() + 1);
+        hashValue(hash, obstacle.center);
+        hashValue(hash, obstacle.a);
+        hashValue(hash, obstacle.b);
+        hashValue(hash, obstacle.size);
+        hashValue(hash, obstacle.radius);
+    }
+    hashValue(hash, settleSteps);
+    hashValue(hash, timeStep);
+    return hash;
+}
+
+void Scenario::configure(Simulation &sim) const {
+    sim.width = width;
+    sim.height = height;
+    for (const pair<string, float> &parameter : parameters) {
+        sim.setParameter(parameter.first, parameter.second);
+    }
+
+    sim.obstacles.clear();
+    for (const ObstacleShape &obstacle : obstacles) {
+        if (obstacle.type == "circle") sim.obstacles.addCircle(obstacle.center, obstacle.radius);
+        else if (obstacle.type == "capsule") sim.obstacles.addCapsule(obstacle.a, obstacle.b, obstacle.radius);
+        else sim.obstacles.addBox(obstacle.center, obstacle.size);
+    }
+    if (!sim.obstacles.empty()) {
+        sim.bakeObstacles();
+    }
+}
+
+void Scenario::generate(Simulation &sim) const {
+    sim.water.clear();
+    for (const FluidBlock &block : blocks) {
+        mt19937 gen(block.seed);
+        uniform_real_distribution<float> jitter(-block.jitter, block.jitter);
+        for (float y = block.min.y; y <= block.max.y; y += block.spacing) {
+            for (float x = block.min.x; x <= block.max.x; x += block.spacing) {
+                WaterDrop drop(x + jitter(gen), y + jitter(gen), 0, block.radius);
+                if (!sim.obstacles.empty() && sim.obstacles.evaluate(vec2(drop.position)) < block.radius) {
+                    continue;
+                }
+                drop.velocity = vec3(block.velocity, 0);
+                sim.water.push_back(drop);
+            }
+        }
+    }
+    sim.adoptDrops();
+    for (int step = 0; step < settleSteps; step++) {
+        sim.step(timeStep);
+    }
+}
+
+bool Scenario::initialize(Simulation &sim, const string &cacheDir) const {
+    configure(sim);
+    bool cached = loadInitialState(sim, cacheDir);
+    start(sim);
+    return cached;
+}
+
+void Scenario::initialize(Simulation &sim, const vector<WaterDrop> &drops) const {
+    configure(sim);
+    sim.water = drops;
+    sim.adoptDrops();
+    start(sim);
+}
+
+void Scenario::start(Simulation &sim) const {
+    sim.reserve(capacity);
+    sim.emitters = emitters;
+    sim.sinks = sinks;
+}
+
+bool Scenario::loadInitialState(Simulation &sim, const string &cacheDir) const {
+    uint64_t hash = initialStateHash();
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash);
+    string path = cacheDir + name;
+
+    // Header: magic, version, hash, drop count
+    ifstream cached(path, ios::binary);
+    if (cached.is_open()) {
+        char magic[4];
+        uint32_t version = 0;
+        uint64_t storedHash = 0;
+        uint32_t count = 0;
+        cached.read(magic, 4);
+        cached.read((char *)&version, sizeof(version));
+        cached.read((char *)&storedHash, sizeof(storedHash));
+        cached.read((char *)&count, sizeof(count));
+        if (cached && equal(magic, magic + 4, cacheMagic) && version == cacheVersion && storedHash == hash) {
+            vector<CachedDrop> drops(count);
+            cached.read((char *)drops.data(), count * sizeof(CachedDrop));
+            if (cached) {
+                sim.water.clear();
+                for (const CachedDrop &drop : drops) {
+                    sim.water.push_back(WaterDrop(drop.x, drop.y, 0, drop.radius));
+                    sim.water.back().velocity = vec3(drop.vx, drop.vy, 0);
+                }
+                sim.adoptDrops();
+                return true;
+            }
+        }
+        cerr << "Ignoring stale or damaged cache file " << path << endl;
+    }
+
+    generate(sim);
+
+    // Written to a temporary name, unique to the process and thread, first
+    // so concurrent runs never read half a file or write into the same one
+#ifdef _WIN32
+    _mkdir(cacheDir.c_str());
+#else
+    mkdir(cacheDir.c_str(), 0755);
+#endif
+    string temporary = path + "." + to_string(getpid()) + "." +
+                       to_string(std::hash<thread::id>()(this_thread::get_id())) + "." +
+                       to_string(chrono::steady_clock::now().time_since_epoch().count());
+    ofstream out(temporary, ios::binary);
+    if (!out.is_open()) {
+        cerr << "Could not write to cache directory " << cacheDir << endl;
+        return false;
+    }
+    uint32_t count = (uint32_t)sim.water.size();
+    out.write(cacheMagic, 4);
+    out.write((const char *)&cacheVersion, sizeof(cacheVersion));
+    out.write((const char *)&hash, sizeof(hash));
+    out.write((const char *)&count, sizeof(count));
+    for (const WaterDrop &drop : sim.water) {
+        CachedDrop packed = {drop.radius, drop.position.x, drop.position.y, drop.velocity.x, drop.velocity.y};
+        out.write((const char *)&packed, sizeof(packed));
+    }
+    out.close();
+    if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+    }
+    return false;
+}
+
+string trim(const string &text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == string::npos) return "";
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+int runScenario(const string &fileName, const string &trajectoryFile, int trajectoryInterval) {
+    Scenario scenario;
+    if (!scenario.load(fileName)) return 1;
+    if (!trajectoryFile.empty()) {
+        scenario.trajectoryFile = trajectoryFile;
+        scenario.trajectoryInterval = std::max(trajectoryInterval, 1);
+    }
+
+    Simulation sim(scenario.threads > 0 ? scenario.threads : std::thread::hardware_concurrency());
+    auto start = chrono::high_resolution_clock::now();
+    bool cached = scenario.initialize(sim);
+    cout << (cached ? "Loaded " : "Generated ") << sim.water.size() << " drops in "
+         << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+
+    ofstream file;
+    if (!scenario.metricsFile.empty()) {
+        file.open(scenario.metricsFile);
+        if (!file.is_open()) {
+            cerr << "Could not open file: '" << scenario.metricsFile << "'" << endl;
+            return 1;
+        }
+    }
+    ostream &out = file.is_open() ? file : cout;
+    out << "step,drops,kinetic_energy,density_error,steps_per_second" << endl;
+
+    TrajectoryWriter trajectory;
+    if (!scenario.trajectoryFile.empty() && !trajectory.open(scenario.trajectoryFile, sim.width, sim.height)) {
+        return 1;
+    }
+    double captureMs = 0;
+
+    start = chrono::high_resolution_clock::now();
+    for (int step = 1; step <= scenario.steps; step++) {
+        sim.step(scenario.timeStep);
+        if (step % scenario.metricsInterval == 0 || step == scenario.steps) {
+            double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+            out << step << "," << sim.water.size() << "," << sim.kineticEnergy() << "," << sim.densityError() << ","
+                << step / seconds << endl;
+        }
+        if (trajectory.isOpen() && step % scenario.trajectoryInterval == 0) {
+            auto captureStart = chrono::high_resolution_clock::now();
+            trajectory.capture(sim, step, step * scenario.timeStep);
+            captureMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - captureStart).count();
+        }
+    }
+
+    if (trajectory.isOpen()) {
+        bool written = trajectory.close();
+        long long frames = trajectory.getFramesWritten() + trajectory.getFramesDropped();
+        cout << "Wrote " << trajectory.getFramesWritten() << " frames (" << trajectory.getFramesDropped()
+             << " dropped) of " << trajectory.getBytesWritten() / 1048576.0 << " MB to " << scenario.trajectoryFile
+             << ", " << (frames > 0 ? captureMs / frames : 0) << " ms per capture" << endl;
+        if (!written) return 1;
+    }
+    return 0;
+}
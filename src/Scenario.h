@@ -0,0 +1,104 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Simulation.h"
+#include "Emitter.h"
+
+// Rectangle of drops on a regular lattice, optionally jittered
+struct FluidBlock {
+    glm::vec2 min = glm::vec2(-1, -1);
+    glm::vec2 max = glm::vec2(1, 1);
+    float spacing = 0.2f;
+    float jitter = 0;
+    float radius = 0.1f;
+    glm::vec2 velocity = glm::vec2(0, 0);
+    unsigned int seed = 1;
+};
+
+// Static obstacle shape, see SignedDistanceField
+struct ObstacleShape {
+    std::string type = "circle";  // circle, capsule or box
+    glm::vec2 center = glm::vec2(0, 0);
+    glm::vec2 a = glm::vec2(0, 0);
+    glm::vec2 b = glm::vec2(0, 0);
+    glm::vec2 size = glm::vec2(1, 1);  // box half size
+    float radius = 1;
+};
+
+// Everything needed to reproduce a run, read from a scenario file:
+//
+//   [domain]       width, height
+//   [parameters]   any Simulation parameter, e.g. gravity = -9.8
+//   [block]        min, max, spacing, jitter, radius, velocity, seed
+//   [emitter]      position, velocity, rate, spread, radius
+//   [sink]         min, max
+//   [obstacle]     type = circle (center, radius), capsule (a, b, radius)
+//                  or box (center, size as half extents)
+//   [run]          steps, settle, dt, threads, capacity
+//   [output]       metrics (CSV file), interval, trajectory (file of
+//                  snapshots, see Trajectory.h), trajectoryInterval
+//
+// Each [block], [emitter], [sink] and [obstacle] section adds one. Lattice
+// points of a block inside an obstacle are left empty. Vectors are written as two
+// numbers, e.g. min = -8 -5, and # starts a comment.
+class Scenario {
+public:
+    float width = 18;
+    float height = 12;
+    std::vector<std::pair<std::string, float>> parameters;
+    std::vector<FluidBlock> blocks;
+    std::vector<Emitter> emitters;
+    std::vector<Sink> sinks;
+    std::vector<ObstacleShape> obstacles;
+
+    int steps = 600;
+    int settleSteps = 0;  // steps run once before the scenario starts
+    float timeStep = 0.016f;
+    int threads = 0;      // 0 for every core
+    int capacity = 0;     // most drops alive at once, 0 for the initial count
+
+    std::string metricsFile;
+    int metricsInterval = 60;
+    std::string trajectoryFile;
+    int trajectoryInterval = 10;
+
+    // Prints the problem and returns false on a malformed file
+    bool load(const std::string &fileName);
+
+    // Hash of everything the initial state depends on
+    uint64_t initialStateHash() const;
+
+    // Sets the domain, parameters and obstacles
+    void configure(Simulation &sim) const;
+
+    // Configures sim and fills it with the blocks after settling. The
+    // settled state is cached in cacheDir under its hash and reused when
+    // present. Emitters and sinks start afterwards. Returns whether the
+    // state came from the cache.
+    bool initialize(Simulation &sim, const std::string &cacheDir = "scenario-cache") const;
+    // Same, starting from drops an earlier initialize() produced
+    void initialize(Simulation &sim, const std::vector<WaterDrop> &drops) const;
+
+private:
+    // Capacity, emitters and sinks, once the drops are in place
+    void start(Simulation &sim) const;
+    void generate(Simulation &sim) const;
+    bool loadInitialState(Simulation &sim, const std::string &cacheDir) const;
+};
+
+// text without leading or trailing spaces, tabs and carriage returns, as
+// the scenario and sweep readers compare it
+std::string trim(const std::string &text);
+
+// Headless run of a scenario file, writing its metrics output. A
+// trajectoryFile replaces the one in [output], saving every
+// trajectoryInterval-th step.
+int runScenario(const std::string &fileName, const std::string &trajectoryFile = "", int trajectoryInterval = 1);
+
+#endif // SCENARIO_H
@@ -63,7 +63,7 @@ void Shape::init()
 {
    // Initialize the vertex array object
    glGenVertexArrays(1, &vaoID);
-   glBindVertexArray(vaoID);
+   GLSL::bindVertexArray(vaoID);
 
 	// Send the position array to the GPU
 	glGenBuffers(1, &posBufID);
@@ -100,51 +100,47 @@ void Shape::init()
 	assert(glGetError() == GL_NO_ERROR);
 }
 
-//always untextured for intro labs until texture mapping
-void Shape::draw(const shared_ptr<Program> prog) const
+void Shape::configure(const Program &prog) const
 {
-	int h_pos, h_nor, h_tex;
-	h_pos = h_nor = h_tex = -1;
+	GLSL::bindVertexArray(vaoID);
 
-   glBindVertexArray(vaoID);
 	// Bind position buffer
-	h_pos = prog->getAttribute("vertPos");
+	GLint h_pos = prog.getAttribute("vertPos");
 	GLSL::enableVertexAttribArray(h_pos);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	
+	GLSL::vertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+
 	// Bind normal buffer
-	h_nor = prog->getAttribute("vertNor");
+	GLint h_nor = prog.getAttribute("vertNor");
 	if(h_nor != -1 && norBufID != 0) {
 		GLSL::enableVertexAttribArray(h_nor);
 		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
 		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
 	}
 
-	if (texBufID != 0) {	
+	if (texBufID != 0) {
 		// Bind texcoords buffer
-		h_tex = prog->getAttribute("vertTex");
-		if(h_tex != -1 && texBufID != 0) {
+		GLint h_tex = prog.getAttribute("vertTex");
+		if(h_tex != -1) {
 			GLSL::enableVertexAttribArray(h_tex);
 			glBindBuffer(GL_ARRAY_BUFFER, texBufID);
 			glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
 		}
 	}
-	
-	// Bind element buffer
+
+	// The element buffer binding is part of the VAO
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
-	
-	// Draw
-	glDrawElements(GL_TRIANGLES, (int)eleBuf.size(), GL_UNSIGNED_INT, (const void *)0);
-	
-	// Disable and unbind
-	if(h_tex != -1) {
-		GLSL::disableVertexAttribArray(h_tex);
-	}
-	if(h_nor != -1) {
-		GLSL::disableVertexAttribArray(h_nor);
-	}
-	GLSL::disableVertexAttribArray(h_pos);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	configuredPID = prog.getPID();
+}
+
+//always untextured for intro labs until texture mapping
+void Shape::draw(const shared_ptr<Program> &prog) const
+{
+	if (configuredPID != prog->getPID()) {
+		configure(*prog);
+	}
+	GLSL::bindVertexArray(vaoID);
+	glDrawElements(GL_TRIANGLES, (int)eleBuf.size(), GL_UNSIGNED_INT, (const void *)0);
 }
@@ -18,7 +18,7 @@ public:
 	void createShape(tinyobj::shape_t & shape);
 	void init();
 	void measure();
-	void draw(const std::shared_ptr<Program> prog) const;
+	void draw(const std::shared_ptr<Program> &prog) const;
 	glm::vec3 min;
 	glm::vec3 max;
 	
@@ -33,6 +33,11 @@ private:
 	unsigned texBufID;
     unsigned vaoID;
 	bool texOff;
+
+	// The program whose attributes the VAO is set up for. The VAO keeps
+	// that setup, so draws with the same program only bind it.
+	mutable unsigned configuredPID = 0;
+	void configure(const Program &prog) const;
 };
 
 #endif
@@ -0,0 +1,91 @@
+#include "SignedDistanceField.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace glm;
+
+void SignedDistanceField::addCircle(vec2 center, float radius) {
+    shapes.push_back({Shape::Circle, center, center, radius});
+    values.clear();
+}
+
+void SignedDistanceField::addCapsule(vec2 a, vec2 b, float radius) {
+    shapes.push_back({Shape::Capsule, a, b, radius});
+    values.clear();
+}
+
+void SignedDistanceField::addBox(vec2 center, vec2 halfSize) {
+    shapes.push_back({Shape::Box, center, halfSize, 0});
+    values.clear();
+}
+
+void SignedDistanceField::clear() {
+    shapes.clear();
+    values.clear();
+}
+
+float SignedDistanceField::evaluate(vec2 point) const {
+    float distance = FLT_MAX;
+    for (const Shape &shape : shapes) {
+        float d;
+        switch (shape.type) {
+        case Shape::Circle:
+            d = length(point - shape.a) - shape.radius;
+            break;
+        case Shape::Capsule: {
+            vec2 along = shape.b - shape.a;
+            float t = clamp(dot(point - shape.a, along) / std::max(dot(along, along), 1e-12f), 0.0f, 1.0f);
+            d = length(point - (shape.a + along * t)) - shape.radius;
+            break;
+        }
+        default: {
+            vec2 q = abs(point - shape.a) - shape.b;
+            d = length(max(q, vec2(0, 0))) + std::min(std::max(q.x, q.y), 0.0f);
+            break;
+        }
+        }
+        // Union
+        distance = std::min(distance, d);
+    }
+    return distance;
+}
+
+void SignedDistanceField::bake(vec2 min, vec2 max, float spacing) {
+    this->spacing = spacing;
+    inverseSpacing = 1 / spacing;
+    origin = min;
+    gridWidth = (int)ceil((max.x - min.x) * inverseSpacing) + 1;
+    gridHeight = (int)ceil((max.y - min.y) * inverseSpacing) + 1;
+
+    values.resize(gridWidth * gridHeight);
+    for (int y = 0; y < gridHeight; y++) {
+        for (int x = 0; x < gridWidth; x++) {
+            values[y * gridWidth + x] = evaluate(gridPoint(x, y));
+        }
+    }
+}
+
+float SignedDistanceField::sample(vec2 point, vec2 &gradient) const {
+    vec2 cell = (point - origin) * inverseSpacing;
+    cell = clamp(cell, vec2(0, 0), vec2(gridWidth - 1.001f, gridHeight - 1.001f));
+    int x = (int)cell.x;
+    int y = (int)cell.y;
+    float fx = cell.x - x;
+    float fy = cell.y - y;
+
+    const float *row = &values[y * gridWidth + x];
+    float d00 = row[0];
+    float d10 = row[1];
+    float d01 = row[gridWidth];
+    float d11 = row[gridWidth + 1];
+
+    // Derivative of the bilinear interpolant
+    gradient.x = ((d10 - d00) * (1 - fy) + (d11 - d01) * fy) * inverseSpacing;
+    gradient.y = ((d01 - d00) * (1 - fx) + (d11 - d10) * fx) * inverseSpacing;
+
+    float bottom = d00 + (d10 - d00) * fx;
+    float top = d01 + (d11 - d01) * fx;
+    return bottom + (top - bottom) * fy;
+}
@@ -0,0 +1,55 @@
+#ifndef SIGNEDDISTANCEFIELD_H
+#define SIGNEDDISTANCEFIELD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Static obstacles as the union of analytic shapes, baked into a sampled
+// distance grid so a lookup costs the same however many shapes there are.
+// Distances are negative inside an obstacle.
+class SignedDistanceField {
+public:
+    void addCircle(glm::vec2 center, float radius);
+    // Segment from a to b thickened by radius
+    void addCapsule(glm::vec2 a, glm::vec2 b, float radius);
+    void addBox(glm::vec2 center, glm::vec2 halfSize);
+    void clear();
+
+    bool empty() const { return shapes.empty(); }
+
+    // Exact distance to the nearest shape
+    float evaluate(glm::vec2 point) const;
+
+    // Samples evaluate() every spacing over [min, max]
+    void bake(glm::vec2 min, glm::vec2 max, float spacing);
+    bool isBaked() const { return !values.empty(); }
+
+    // Bilinear distance from the baked grid and its gradient, which points
+    // away from the nearest obstacle. Clamped to the edge of the grid.
+    float sample(glm::vec2 point, glm::vec2 &gradient) const;
+
+    int getGridWidth() const { return gridWidth; }
+    int getGridHeight() const { return gridHeight; }
+    glm::vec2 gridPoint(int x, int y) const { return origin + glm::vec2(x, y) * spacing; }
+    float gridValue(int x, int y) const { return values[y * gridWidth + x]; }
+
+private:
+    struct Shape {
+        enum Type { Circle, Capsule, Box };
+        Type type;
+        glm::vec2 a;
+        glm::vec2 b;  // capsule end, or box half size
+        float radius;
+    };
+
+    std::vector<Shape> shapes;
+
+    std::vector<float> values;
+    glm::vec2 origin = glm::vec2(0, 0);
+    float spacing = 1;
+    float inverseSpacing = 1;
+    int gridWidth = 0;
+    int gridHeight = 0;
+};
+
+#endif // SIGNEDDISTANCEFIELD_H
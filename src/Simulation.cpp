@@ -0,0 +1,662 @@
+#include "Simulation.h"
+#include "KernelVariants.h"
+#include "Tracer.h"
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+// Direction from drop i towards drop j when they sit on the same point.
+// Hashed from the pair rather than drawn from a shared random generator, so
+// it does not depend on which worker asks or in what order, and j is pushed
+// exactly opposite to i.
+static vec3 coincidentDirection(int i, int j) {
+    uint32_t hash = (uint32_t)std::min(i, j) * 2654435761u ^ (uint32_t)std::max(i, j) * 2246822519u;
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+    float angle = hash * (6.28318531f / 4294967296.0f);
+    vec3 direction = vec3(cos(angle), sin(angle), 0);
+    return i < j ? direction : -direction;
+}
+
+namespace {
+
+// Drops gathered at a time for the wall pass
+const int wallBlock = 64;
+
+// Adds the time and allocations of its scope to a phase's totals
+class PhaseScope {
+public:
+    PhaseScope(Simulation::PhaseStats *phaseStats, int phase, const PerfCounters *counters)
+        : stats(phaseStats[phase]), counters(counters), span(Simulation::phaseName(phase), "simulation") {
+        if (counters) eventsStart = counters->read();
+        heapStart = allocationCount();
+        start = chrono::high_resolution_clock::now();
+    }
+
+    ~PhaseScope() {
+        stats.ms += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        stats.heap = stats.heap + (allocationCount() - heapStart);
+        if (counters) stats.events = stats.events + (counters->read() - eventsStart);
+    }
+
+private:
+    Simulation::PhaseStats &stats;
+    const PerfCounters *counters;
+    chrono::high_resolution_clock::time_point start;
+    AllocationCount heapStart;
+    PerfCount eventsStart;
+    TraceSpan span;
+};
+
+} // namespace
+
+Simulation::Simulation(int numThreads)
+    : grid(make_shared<UniformGrid>()), scheduler(make_shared<TaskScheduler>(numThreads)) {}
+
+bool Simulation::isParameter(const string &name) {
+    static const char *names[] = {"width", "height", "gravity", "collisionDamping", "targetDensity",
+                                  "pressureMultiplier", "kernelRadius", "viscosityStrength"};
+    for (const char *parameter : names) {
+        if (name == parameter) return true;
+    }
+    return false;
+}
+
+bool Simulation::setParameter(const string &name, float value) {
+    if (name == "width") width = value;
+    else if (name == "height") height = value;
+    else if (name == "gravity") gravity.y = value;
+    else if (name == "collisionDamping") collisionDamping = value;
+    else if (name == "targetDensity") targetDensity = value;
+    else if (name == "pressureMultiplier") pressureMultiplier = value;
+    else if (name == "kernelRadius") kernelRadius = value;
+    else if (name == "viscosityStrength") viscosityStrength = value;
+    else return false;
+    return true;
+}
+
+void Simulation::setup(int numWaterDrops) {
+    water.clear();
+    if (numWaterDrops == 1) {
+        water.push_back(WaterDrop(0, 0, 0, 1));
+    } else {
+        float sqrtDrops = sqrt(numWaterDrops);
+        float squareSize = ceil(sqrtDrops);
+
+        for (int i = 0; i < squareSize; i++) {
+            for (int j = 0; j < squareSize; j++) {
+                float radius = 1 / sqrtDrops;
+                float x = (2 - 2 / sqrtDrops) * ((i / (squareSize - 1)) - 0.5);
+                float y = -(2 - 2 / sqrtDrops) * ((j / (squareSize - 1)) - 0.5);
+
+                if (j * squareSize + i < numWaterDrops) {
+                    water.push_back(WaterDrop(x, y, 0, radius));
+                }
+            }
+        }
+    }
+    adoptDrops();
+}
+
+void Simulation::setupRandom(int numWaterDrops, unsigned int seed) {
+    water.clear();
+    random_device rd;
+    mt19937 gen(seed ? seed : rd());
+
+    uniform_real_distribution<float> x_distrib(-width / 2, width / 2);
+    uniform_real_distribution<float> y_distrib(-height / 2, height / 2);
+
+    for (int i = 0; i < numWaterDrops; i++) {
+        float x = x_distrib(gen);
+        float y = y_distrib(gen);
+
+        // float scale = 10 / (float)numWaterDrops;
+        // float scale = 0.04; // 1 / 25
+        float scale = 0.1;
+
+        water.push_back(WaterDrop(x, y, 0, scale));
+    }
+    adoptDrops();
+}
+
+bool Simulation::predictionsCurrent() const {
+    return predictionsStreamed && predictedPositions.size() == water.size();
+}
+
+void Simulation::reserve(int capacity) {
+    reserveBuffer(water, capacity, bufferAllocations);
+    reserveBuffer(predictedPositions, capacity, bufferAllocations);
+    reserveBuffer(densities, capacity, bufferAllocations);
+    reserveBuffer(accelerations, capacity, bufferAllocations);
+    reserveBuffer(cellKeys, capacity, bufferAllocations);
+    pool.reserve(capacity, bufferAllocations);
+}
+
+int Simulation::addDrop(const WaterDrop &drop) {
+    int id = pool.acquire();
+    if (id < 0) return -1;
+    water.push_back(drop);
+    if (predictionsStreamed) {
+        vec3 predicted = drop.position + drop.velocity * 1.0f / 120.0f;
+        predictedPositions.push_back(predicted);
+        cellKeys.push_back(grid->bucketOf(predicted.x, predicted.y));
+    }
+    return id;
+}
+
+void Simulation::removeDrop(int index) {
+    pool.release(index);
+    water[index] = water.back();
+    water.pop_back();
+    if (predictionsStreamed) {
+        predictedPositions[index] = predictedPositions.back();
+        predictedPositions.pop_back();
+        cellKeys[index] = cellKeys.back();
+        cellKeys.pop_back();
+    }
+}
+
+void Simulation::adoptDrops() {
+    if ((int)water.size() > pool.capacity()) {
+        reserve(water.size());
+    }
+    pool.reset(water.size());
+    predictionsStreamed = false;
+}
+
+void Simulation::step(float deltaTime) {
+    beginStep();
+    updateEmitters(deltaTime);
+    if (!predictionsCurrent()) {
+        predictPositions();
+    }
+    updateGrid();
+    computeDensities();
+    integrate(deltaTime);
+}
+
+void Simulation::beginStep() {
+    arena.reset();
+    scheduler->resetStats();
+    stepStartAllocations = totalAllocations();
+    for (PhaseStats &stats : phaseStats) {
+        stats = PhaseStats();
+    }
+}
+
+void Simulation::setThreadCount(int numThreads) {
+    numThreads = std::max(1, numThreads);
+    if (numThreads == scheduler->getThreadCount()) return;
+    scheduler = make_shared<TaskScheduler>(numThreads);
+
+    // The counters were attached to the old threads
+    string error;
+    if (counters) openCounters(error);
+}
+
+bool Simulation::openCounters(string &error) {
+    counters = make_shared<PerfCounters>();
+    if (!counters->open(scheduler->getThreadIds())) {
+        error = counters->getError();
+        counters.reset();
+        return false;
+    }
+    error = counters->getError();
+    return true;
+}
+
+const char *Simulation::phaseName(int phase) {
+    static const char *names[NumPhases] = {"emit", "predict", "grid", "density", "force", "integrate"};
+    return names[phase];
+}
+
+Simulation::PhaseStats Simulation::getStepStats() const {
+    PhaseStats total;
+    for (const PhaseStats &stats : phaseStats) {
+        total.ms += stats.ms;
+        total.heap = total.heap + stats.heap;
+        total.events = total.events + stats.events;
+    }
+    return total;
+}
+
+HeapCounter Simulation::totalAllocations() const {
+    HeapCounter total = arena.heapAllocations() + grid->heapAllocations() + bufferAllocations;
+    for (const HeapCounter &counter : workerNeighborAllocations) {
+        total = total + counter;
+    }
+    return total;
+}
+
+float Simulation::kineticEnergy() const {
+    float energy = 0;
+    for (const WaterDrop &drop : water) {
+        energy += 0.5f * dot(drop.velocity, drop.velocity);
+    }
+    return energy;
+}
+
+float Simulation::densityError() const {
+    if (water.empty() || densities.size() < water.size()) return 0;
+    float error = 0;
+    for (size_t i = 0; i < water.size(); i++) {
+        error += fabs(densities[i] - targetDensity) / targetDensity;
+    }
+    return error / water.size();
+}
+
+HeapCounter Simulation::stepAllocations() const {
+    return totalAllocations() - stepStartAllocations;
+}
+
+void Simulation::updateEmitters(float deltaTime) {
+    PhaseScope scope(phaseStats, EmitPhase, counters.get());
+    // Backwards so a swapped-in drop has already been checked
+    for (int i = (int)water.size() - 1; i >= 0; i--) {
+        vec3 position = water[i].position;
+        for (const Sink &sink : sinks) {
+            if (position.x >= sink.min.x && position.x <= sink.max.x &&
+                position.y >= sink.min.y && position.y <= sink.max.y) {
+                removeDrop(i);
+                break;
+            }
+        }
+    }
+
+    for (Emitter &emitter : emitters) {
+        uniform_real_distribution<float> offset(-emitter.spread, emitter.spread);
+        emitter.pending += emitter.rate * deltaTime;
+        while (emitter.pending >= 1) {
+            WaterDrop drop(emitter.position.x + offset(emitterRandom), emitter.position.y + offset(emitterRandom), 0,
+                           emitter.radius);
+            drop.velocity = vec3(emitter.velocity, 0);
+            if (addDrop(drop) < 0) {
+                // Full, try again next step
+                emitter.pending = 0;
+                break;
+            }
+            emitter.pending -= 1;
+        }
+    }
+}
+
+void Simulation::predictPositions(int begin) {
+    PhaseScope scope(phaseStats, PredictPhase, counters.get());
+    predictionsStreamed = false;
+    resizeBuffer(predictedPositions, water.size(), bufferAllocations);
+    for (size_t i = begin; i < water.size(); i++) {
+        predictedPositions[i] = water[i].position + water[i].velocity * 1.0f / 120.0f;
+    }
+}
+
+void Simulation::updateGrid() {
+    PhaseScope scope(phaseStats, GridPhase, counters.get());
+    if (auto uniform = dynamic_cast<UniformGrid *>(grid.get())) {
+        uniform->setBounds(width, height);
+    }
+    grid->setCellSize(kernelRadius);
+    grid->reserve(pool.capacity());
+    if (incrementalGrid && predictionsCurrent()) {
+        grid->update(predictedPositions, cellKeys);
+    } else if (incrementalGrid) {
+        grid->update(predictedPositions);
+    } else {
+        grid->build(predictedPositions);
+    }
+    buildCellBlocks();
+}
+
+void Simulation::buildCellBlocks() {
+    // A few blocks per thread leaves the idle ones something to steal
+    int numParticles = (int)predictedPositions.size();
+    int target = std::max(1, numParticles / (scheduler->getThreadCount() * 8));
+
+    cellBlocks.clear();
+    reserveBuffer(cellBlocks, numParticles / target + 2, bufferAllocations);
+    Task block = { 0, 0, 0 };
+    for (int bucket = 0; bucket < grid->numBuckets(); bucket++) {
+        block.weight += (int)(grid->bucketEnd(bucket) - grid->bucketBegin(bucket));
+        block.end = bucket + 1;
+        if (block.weight >= target) {
+            cellBlocks.push_back(block);
+            block = { block.end, block.end, 0 };
+        }
+    }
+    if (block.weight > 0) {
+        cellBlocks.push_back(block);
+    }
+}
+
+void Simulation::computeDensities(int count) {
+    PhaseScope scope(phaseStats, DensityPhase, counters.get());
+    if (count < 0) count = (int)water.size();
+    resizeBuffer(densities, water.size(), bufferAllocations);
+    if (!neighborLists) {
+        scheduler->run(cellBlocks, [&](const Task &block, int) {
+            forEachInBlock(block, count, [&](int i) {
+                densities[i] = calculateDensity(i);
+            });
+        });
+        return;
+    }
+
+    int numWorkers = scheduler->getThreadCount();
+    if ((int)workerNeighbors.size() != numWorkers) {
+        workerNeighbors.resize(numWorkers);
+        workerNeighborAllocations.resize(numWorkers);
+    }
+    for (vector<Neighbor> &list : workerNeighbors) {
+        list.clear();
+    }
+    resizeBuffer(neighborRanges, water.size(), bufferAllocations);
+
+    scheduler->run(cellBlocks, [&](const Task &block, int worker) {
+        forEachInBlock(block, count, [&](int i) {
+            gatherNeighbors(i, worker);
+            densities[i] = densityFromNeighbors(i);
+        });
+    });
+}
+
+void Simulation::gatherNeighbors(int i, int worker) {
+    vector<Neighbor> &list = workerNeighbors[worker];
+    vec3 position = water[i].position;
+
+    int buckets[9];
+    int numBuckets = grid->neighborBuckets(position.x, position.y, buckets);
+    size_t candidates = 0;
+    for (int b = 0; b < numBuckets; b++) {
+        candidates += grid->bucketEnd(buckets[b]) - grid->bucketBegin(buckets[b]);
+    }
+    reserveBuffer(list, list.size() + candidates, workerNeighborAllocations[worker]);
+
+    NeighborRange &range = neighborRanges[i];
+    range.worker = worker;
+    range.begin = (int)list.size();
+    for (int b = 0; b < numBuckets; b++) {
+        for (const int *it = grid->bucketBegin(buckets[b]); it != grid->bucketEnd(buckets[b]); ++it) {
+            // Same expressions as the grid-walking versions so both modes
+            // give identical results
+            float distance = length(vec2(water[*it].position.x, water[*it].position.y) - vec2(position.x, position.y));
+            vec3 predictedOffset = predictedPositions[*it] - position;
+            float predictedDistance = length(predictedOffset);
+            if (distance < kernelRadius || predictedDistance < kernelRadius) {
+                list.push_back({*it, distance, predictedDistance, vec2(predictedOffset.x, predictedOffset.y)});
+            }
+        }
+    }
+    range.end = (int)list.size();
+}
+
+float Simulation::densityFromNeighbors(int i) const {
+    const NeighborRange &range = neighborRanges[i];
+    const Neighbor *neighbors = workerNeighbors[range.worker].data();
+    float density = 0;
+    for (int n = range.begin; n < range.end; n++) {
+        density += smoothingKernel(kernelRadius, neighbors[n].distance);
+    }
+    return density;
+}
+
+vec3 Simulation::accelerationFromNeighbors(int i) const {
+    const NeighborRange &range = neighborRanges[i];
+    const Neighbor *neighbors = workerNeighbors[range.worker].data();
+    float sampleDensity = densities[i];
+    vec3 velocity = water[i].velocity;
+
+    // Pressure and viscosity need the same pairs, so one loop does both
+    vec3 pressureForce = vec3(0.0f, 0.0f, 0.0f);
+    vec3 viscosityForce = vec3(0.0f, 0.0f, 0.0f);
+    for (int n = range.begin; n < range.end; n++) {
+        const Neighbor &neighbor = neighbors[n];
+        int j = neighbor.index;
+
+        viscosityForce += viscositySmoothingKernel(kernelRadius, neighbor.distance) * (velocity - water[j].velocity);
+
+        if (j == i) continue;
+        vec3 direction;
+        if (neighbor.predictedDistance == 0) {
+            direction = coincidentDirection(i, j);
+        } else {
+            direction = vec3(neighbor.predictedOffset, 0) / neighbor.predictedDistance;
+        }
+        float slope = smoothingKernelDerivative(kernelRadius, neighbor.predictedDistance);
+        float density = densities[j];
+        float sharedPressure = calculateSharedPressure(density, sampleDensity);
+        pressureForce += sharedPressure * direction * slope / density;
+    }
+    return pressureForce / sampleDensity + viscosityForce * viscosityStrength + gravity;
+}
+
+void Simulation::integrate(float deltaTime, int count) {
+    if (count < 0) count = (int)water.size();
+    {
+        PhaseScope scope(phaseStats, ForcePhase, counters.get());
+        resizeBuffer(accelerations, water.size(), bufferAllocations);
+        scheduler->run(cellBlocks, [&](const Task &block, int) {
+            forEachInBlock(block, count, [&](int i) {
+                if (neighborLists) {
+                    accelerations[i] = accelerationFromNeighbors(i);
+                    return;
+                }
+                vec3 pressure = calculatePressureForce(i) / densities[i];
+                vec3 viscosity = calculateViscosity(i);
+                accelerations[i] = pressure + viscosity + gravity;
+            });
+        });
+    }
+
+    integrateAndPredict(deltaTime, count);
+}
+
+template <typename Before, typename After>
+void Simulation::streamPass(int count, Before before, After after) {
+    if (count < 0) count = (int)water.size();
+    buildParticleChunks(count);
+    if (!obstacles.empty() && !obstacles.isBaked()) {
+        bakeObstacles();
+    }
+    bool collide = !obstacles.empty();
+
+    if (legacyBoundaries) {
+        scheduler->run(particleChunks, [&](const Task &chunk, int) {
+            for (int i = chunk.begin; i < chunk.end; i++) {
+                before(water[i], i);
+                water[i].ResolveOutOfBounds(width, height, collisionDamping);
+                if (collide) collideWithObstacle(water[i]);
+                after(water[i], i);
+            }
+        });
+        return;
+    }
+
+    // The drops are an array of structs, so each block is gathered into
+    // arrays per field for the SIMD wall pass and scattered back afterwards
+    scheduler->run(particleChunks, [&](const Task &chunk, int) {
+        WaterDrop *drops = water.data();
+        float x[wallBlock], y[wallBlock], velocityX[wallBlock], velocityY[wallBlock], radius[wallBlock];
+        for (int blockBegin = chunk.begin; blockBegin < chunk.end; blockBegin += wallBlock) {
+            int count = std::min(wallBlock, chunk.end - blockBegin);
+            WaterDrop *block = drops + blockBegin;
+            for (int k = 0; k < count; k++) {
+                before(block[k], blockBegin + k);
+                x[k] = block[k].position.x;
+                y[k] = block[k].position.y;
+                velocityX[k] = block[k].velocity.x;
+                velocityY[k] = block[k].velocity.y;
+                radius[k] = block[k].radius;
+            }
+            reflectAxisSimd(y, velocityY, velocityX, radius, height / 2, collisionDamping, count);
+            reflectAxisSimd(x, velocityX, velocityY, radius, width / 2, collisionDamping, count);
+            for (int k = 0; k < count; k++) {
+                WaterDrop &drop = block[k];
+                drop.position.x = x[k];
+                drop.position.y = y[k];
+                drop.velocity.x = velocityX[k];
+                drop.velocity.y = velocityY[k];
+                if (collide) collideWithObstacle(drop);
+                after(drop, blockBegin + k);
+            }
+        }
+    });
+}
+
+void Simulation::resolveBoundaries(int count) {
+    auto nothing = [](WaterDrop &, int) {};
+    streamPass(count, nothing, nothing);
+}
+
+void Simulation::integrateAndPredict(float deltaTime, int count) {
+    PhaseScope scope(phaseStats, IntegratePhase, counters.get());
+    auto move = [&](WaterDrop &drop, int i) {
+        drop.Update(accelerations[i], deltaTime);
+        drop.velocity *= 0.99; // Dampening
+    };
+
+    if (!fusedStreaming) {
+        streamPass(count, move, [](WaterDrop &, int) {});
+        return;
+    }
+
+    // Next step's prediction and bucket come for free while the drop is
+    // still in cache, saving the predict loop and the grid's binning loop
+    resizeBuffer(predictedPositions, water.size(), bufferAllocations);
+    resizeBuffer(cellKeys, water.size(), bufferAllocations);
+    const SpatialGrid &bins = *grid;
+    streamPass(count, move, [&](WaterDrop &drop, int i) {
+        vec3 predicted = drop.position + drop.velocity * 1.0f / 120.0f;
+        predictedPositions[i] = predicted;
+        cellKeys[i] = bins.bucketOf(predicted.x, predicted.y);
+    });
+    predictionsStreamed = count == (int)water.size();
+}
+
+void Simulation::bakeObstacles() {
+    vec2 corner(width / 2 + kernelRadius, height / 2 + kernelRadius);
+    obstacles.bake(-corner, corner, obstacleResolution);
+}
+
+void Simulation::collideWithObstacle(WaterDrop &drop) const {
+    // One lookup gives both the penetration depth and the way out
+    vec2 gradient;
+    float depth = obstacles.sample(vec2(drop.position), gradient) - drop.radius;
+    vec2 normal = gradient / std::max(length(gradient), 1e-6f);
+    float inside = depth < 0 ? 1.0f : 0.0f;
+
+    drop.position -= vec3(normal * std::min(depth, 0.0f), 0);
+    // Reflect and damp only the velocity heading into the obstacle
+    float into = std::min(dot(vec2(drop.velocity), normal), 0.0f) * inside;
+    drop.velocity -= vec3(normal * into * (1 + collisionDamping), 0);
+}
+
+void Simulation::buildParticleChunks(int count) {
+    // Big enough to amortize scheduling, small enough to balance
+    const int chunkSize = 4096;
+    int numChunks = std::max(1, (count + chunkSize - 1) / chunkSize);
+    resizeBuffer(particleChunks, numChunks, bufferAllocations);
+    for (int c = 0; c < numChunks; c++) {
+        particleChunks[c].begin = c * chunkSize;
+        particleChunks[c].end = std::min(count, (c + 1) * chunkSize);
+        particleChunks[c].weight = particleChunks[c].end - particleChunks[c].begin;
+    }
+}
+
+float Simulation::densityToPressure(float density) const {
+    if (density < 0.0f) {
+        return 0.0f;  // Return zero pressure for negative densities
+    }
+
+    float densityDifference = density - targetDensity;
+    float pressure = densityDifference * pressureMultiplier;
+    return pressure;
+}
+
+float Simulation::calculateSharedPressure(float density1, float density2) const {
+    return (densityToPressure(density1) + densityToPressure(density2)) / 2.0;
+}
+
+vec3 Simulation::calculatePressureForce(int samplePointIndex) const {
+    vec3 pressureForce = vec3(0.0f, 0.0f, 0.0f);
+
+    float x = water[samplePointIndex].position.x;
+    float y = water[samplePointIndex].position.y;
+
+    grid->forEachNeighbor(x, y, [&](int i) {
+        if (i == samplePointIndex) return;
+
+        vec3 difference = predictedPositions[i] - water[samplePointIndex].position;
+        float distance = length(difference);
+
+        vec3 direction;
+        if (distance == 0) {
+            direction = coincidentDirection(samplePointIndex, i);
+        } else {
+            direction = difference / distance;
+        }
+
+        float slope = smoothingKernelDerivative(kernelRadius, distance);
+        float density = densities[i];
+        float mass = 1.0;
+        float sharedPressure = calculateSharedPressure(density, densities[samplePointIndex]);
+        pressureForce += sharedPressure * direction * slope * mass / density;
+    });
+    return pressureForce;
+}
+
+vec3 Simulation::calculateViscosity(int i) const {
+    vec3 viscosityForce = vec3(0.0f, 0.0f, 0.0f);
+
+    float x = water[i].position.x;
+    float y = water[i].position.y;
+
+    grid->forEachNeighbor(x, y, [&](int particleIdx) {
+        float dst = length(water[i].position - water[particleIdx].position);
+        float influence = viscositySmoothingKernel(kernelRadius, dst);
+        viscosityForce += influence * (water[i].velocity - water[particleIdx].velocity);
+    });
+    return viscosityForce * viscosityStrength;
+}
+
+float Simulation::calculateDensity(int i) const {
+    float density = 0;
+    float mass = 1;
+
+    float x = water[i].position.x;
+    float y = water[i].position.y;
+
+    grid->forEachNeighbor(x, y, [&](int particleIdx) {
+        float distance = length(vec2(water[particleIdx].position.x, water[particleIdx].position.y) - vec2(x, y));
+        float influence = smoothingKernel(kernelRadius, distance);
+        density += influence * mass;
+    });
+    return density;
+}
+
+float Simulation::smoothingKernel(float kernelRadius, float distance) {
+    if (distance >= kernelRadius) return 0;
+
+    float volume = (3.1415 * pow(kernelRadius, 4)) / 6;
+    return (kernelRadius - distance) * (kernelRadius - distance) / volume;
+}
+
+float Simulation::smoothingKernelDerivative(float kernelRadius, float distance) {
+    if (distance >= kernelRadius) return 0;
+
+    float scale = 12 / (pow(kernelRadius, 4) * 3.1415);
+    return (distance - kernelRadius) * scale;
+}
+
+float Simulation::viscositySmoothingKernel(float kernelRadius, float distance) {
+    if (distance >= kernelRadius) return 0;
+
+    float volume = (3.1415 * pow(kernelRadius, 4)) / 6;
+    return (kernelRadius - distance) * (kernelRadius - distance) / volume;
+}
@@ -0,0 +1,234 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "WaterDrop.h"
+#include "Emitter.h"
+#include "ParticlePool.h"
+#include "SignedDistanceField.h"
+#include "SpatialGrid.h"
+#include "FrameArena.h"
+#include "TaskScheduler.h"
+#include "AllocationCounter.h"
+#include "PerfCounters.h"
+
+// The SPH fluid step, kept free of any rendering so it can run headless.
+// The step is split into phases so a caller can exchange data between them,
+// e.g. the distributed runner fills in ghost densities between
+// computeDensities() and integrate(). Particles past the count passed to
+// those are ghosts: they take part in neighbor sums but are never
+// integrated. The density, force and integration passes run on the
+// scheduler over blocks of grid buckets.
+class Simulation {
+public:
+    explicit Simulation(int numThreads = std::thread::hardware_concurrency());
+
+    // Box size and fluid parameters, tweaked live from the key bindings
+    float width = 18;
+    float height = 12;
+    glm::vec3 gravity = glm::vec3(0, 0.0, 0);
+    float collisionDamping = 0.5;
+    float targetDensity = 4.0f;
+    float pressureMultiplier = 8;
+    float kernelRadius = 0.9f;
+    float viscosityStrength = -0.5f;
+
+    // Resolve walls with WaterDrop::ResolveOutOfBounds one drop at a time
+    // instead of the branch-free pass
+    bool legacyBoundaries = false;
+
+    std::vector<WaterDrop> water;
+    std::vector<glm::vec3> predictedPositions;
+    std::vector<float> densities;
+    std::vector<glm::vec3> accelerations;
+
+    // Ids of the drops in water, kept by setup(), addDrop() and removeDrop()
+    ParticlePool pool;
+
+    std::vector<Emitter> emitters;
+    std::vector<Sink> sinks;
+
+    // Static obstacles inside the box, baked over it on the first step
+    // after they change
+    SignedDistanceField obstacles;
+    float obstacleResolution = 0.05f;
+
+    // Neighbor search backend and whether to patch it instead of rebuilding
+    std::shared_ptr<SpatialGrid> grid;
+    bool incrementalGrid = true;
+
+    // Gather each particle's neighbors once, in the density pass, and feed
+    // the fused pressure and viscosity loop from that list instead of
+    // walking the grid again
+    bool neighborLists = true;
+
+    // Integrate, damp, resolve walls, predict the next position and bin it
+    // in one pass over the drops, instead of separate loops
+    bool fusedStreaming = true;
+
+    // Scratch memory for temporaries of the current step, used by the
+    // distributed runner's packs and halo lists from the stepping thread
+    FrameArena arena;
+
+    std::shared_ptr<TaskScheduler> scheduler;
+
+    // Runs the density, force and integration passes on numThreads threads
+    // from the next step on, the calling thread included
+    void setThreadCount(int numThreads);
+
+    // Hardware counters sampled around each phase into PhaseStats, off while
+    // null. openCounters() attaches them to the scheduler's threads, and
+    // leaves them null with the reason in error if the machine has none.
+    std::shared_ptr<PerfCounters> counters;
+    bool openCounters(std::string &error);
+
+    // Blocks of consecutive grid buckets holding roughly equal numbers of
+    // particles, the unit of work for the scheduler
+    std::vector<Task> cellBlocks;
+    // Contiguous index ranges, for passes that need no neighbors
+    std::vector<Task> particleChunks;
+
+    // Growth of the persistent per-particle buffers
+    HeapCounter bufferAllocations;
+
+    // Sets a tunable by its member name (gravity sets the y component).
+    // Returns false for an unknown name.
+    bool setParameter(const std::string &name, float value);
+    static bool isParameter(const std::string &name);
+
+    // Square of evenly spaced drops filling [-1, 1]
+    void setup(int numWaterDrops);
+    // Drops scattered over the whole box. A seed of 0 picks a random one.
+    void setupRandom(int numWaterDrops, unsigned int seed = 0);
+
+    // Reserves every per-particle buffer for capacity drops, so adding drops
+    // up to it never reallocates
+    void reserve(int capacity);
+    // Appends a drop if there is room, returning its id or -1
+    int addDrop(const WaterDrop &drop);
+    // Swap-removes the drop at index: the last drop takes its place
+    void removeDrop(int index);
+    // Gives fresh ids to the drops after water was filled directly, growing
+    // the capacity if needed
+    void adoptDrops();
+
+    // Advances every particle by one step
+    void step(float deltaTime);
+
+    // Step phases, in order. Counts default to every particle.
+    void beginStep();
+    // Spawns drops from the emitters and removes those inside sinks
+    void updateEmitters(float deltaTime);
+    // Skippable while predictionsCurrent(), i.e. the last integrate()
+    // already predicted and binned every drop. Drops before begin keep their
+    // predictions.
+    void predictPositions(int begin = 0);
+    bool predictionsCurrent() const;
+    void updateGrid();
+    void computeDensities(int count = -1);
+    // Computes every acceleration before moving anything, so the result does
+    // not depend on the order the blocks run in
+    void integrate(float deltaTime, int count = -1);
+    // Keeps the first count drops inside the box and out of the obstacles,
+    // run by integrate()
+    void resolveBoundaries(int count = -1);
+    void bakeObstacles();
+
+    // Total kinetic energy, and mean |density - target| / target as of the
+    // last density pass
+    float kineticEnergy() const;
+    float densityError() const;
+
+    // Phases timed for the statistics below
+    enum Phase { EmitPhase, PredictPhase, GridPhase, DensityPhase, ForcePhase, IntegratePhase, NumPhases };
+    static const char *phaseName(int phase);
+
+    struct PhaseStats {
+        double ms = 0;
+        // Global operator new calls from any thread during the phase
+        AllocationCount heap;
+        // Summed over the scheduler's threads, while counters are open
+        PerfCount events;
+    };
+    // Totals for each phase, and all of them, since beginStep()
+    const PhaseStats &getPhaseStats(int phase) const { return phaseStats[phase]; }
+    PhaseStats getStepStats() const;
+
+    // Heap allocations made by the arena, the grid and the persistent
+    // buffers since beginStep(). Zero once the simulation is warm.
+    HeapCounter stepAllocations() const;
+
+    float densityToPressure(float density) const;
+    float calculateSharedPressure(float density1, float density2) const;
+    glm::vec3 calculatePressureForce(int samplePointIndex) const;
+    glm::vec3 calculateViscosity(int i) const;
+    float calculateDensity(int i) const;
+
+    static float smoothingKernel(float kernelRadius, float distance);
+    static float smoothingKernelDerivative(float kernelRadius, float distance);
+    static float viscositySmoothingKernel(float kernelRadius, float distance);
+
+private:
+    HeapCounter totalAllocations() const;
+
+    void buildCellBlocks();
+    void buildParticleChunks(int count);
+    void collideWithObstacle(WaterDrop &drop) const;
+
+    // Walks the first count drops in contiguous chunks on the scheduler,
+    // resolving walls and obstacles between before(drop, i) and
+    // after(drop, i)
+    template <typename Before, typename After>
+    void streamPass(int count, Before before, After after);
+    void integrateAndPredict(float deltaTime, int count);
+
+    // Grid buckets of predictedPositions, written by the fused pass
+    std::vector<int> cellKeys;
+    bool predictionsStreamed = false;
+
+    // Neighbor within the kernel radius of a particle, at either its
+    // current position or its predicted one
+    struct Neighbor {
+        int index;
+        float distance;           // between current positions
+        float predictedDistance;  // from the current to the predicted position
+        glm::vec2 predictedOffset;
+    };
+    // Where a particle's neighbors are in the lists of the worker that
+    // gathered them
+    struct NeighborRange {
+        int worker;
+        int begin;
+        int end;
+    };
+
+    void gatherNeighbors(int i, int worker);
+    float densityFromNeighbors(int i) const;
+    glm::vec3 accelerationFromNeighbors(int i) const;
+
+    std::vector<std::vector<Neighbor>> workerNeighbors;
+    std::vector<HeapCounter> workerNeighborAllocations;
+    std::vector<NeighborRange> neighborRanges;
+
+    // Calls visit(particle) for every particle below count in a block
+    template <typename Visitor>
+    void forEachInBlock(const Task &block, int count, Visitor visit) const {
+        for (int bucket = block.begin; bucket < block.end; bucket++) {
+            for (const int *it = grid->bucketBegin(bucket); it != grid->bucketEnd(bucket); ++it) {
+                if (*it < count) visit(*it);
+            }
+        }
+    }
+
+    HeapCounter stepStartAllocations;
+    PhaseStats phaseStats[NumPhases];
+
+    std::mt19937 emitterRandom{1};
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,208 @@
+#include "SocketTransport.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+
+// macOS has no MSG_NOSIGNAL and sets SO_NOSIGPIPE on the socket instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+// Progress of one length-prefixed message through a socket
+struct Transfer {
+    uint64_t length = 0;
+    size_t done = 0; // bytes of header plus payload moved so far
+    const char *payload = nullptr;
+
+    size_t total() const { return sizeof(length) + length; }
+    bool finished() const { return done == total(); }
+
+    char *cursor() {
+        if (done < sizeof(length)) return (char *)&length + done;
+        return const_cast<char *>(payload) + (done - sizeof(length));
+    }
+    size_t chunk() const {
+        if (done < sizeof(length)) return sizeof(length) - done;
+        return total() - done;
+    }
+};
+
+bool writeSome(int fd, Transfer &transfer, int flags) {
+    ssize_t n = ::send(fd, transfer.cursor(), transfer.chunk(), flags | MSG_NOSIGNAL);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    transfer.done += n;
+    return true;
+}
+
+bool readSome(int fd, Transfer &transfer, vector<char> &in, int flags) {
+    ssize_t n = ::recv(fd, transfer.cursor(), transfer.chunk(), flags);
+    if (n == 0) return false;
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    transfer.done += n;
+    if (transfer.done == sizeof(transfer.length)) {
+        in.resize(transfer.length);
+        transfer.payload = in.data();
+    }
+    return true;
+}
+
+} // namespace
+
+unique_ptr<SocketTransport> SocketTransport::launch(int size) {
+    // sockets[i][j] is rank i's end of the pair connecting i and j
+    vector<vector<int>> sockets(size, vector<int>(size, -1));
+    for (int i = 0; i < size; i++) {
+        for (int j = i + 1; j < size; j++) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                perror("socketpair");
+                return nullptr;
+            }
+            sockets[i][j] = pair[0];
+            sockets[j][i] = pair[1];
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+            setsockopt(pair[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+            setsockopt(pair[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        }
+    }
+
+    // Anything still buffered would otherwise be printed once per process
+    cout.flush();
+    cerr.flush();
+
+    int rank = 0;
+    vector<int> workers;
+    for (int r = 1; r < size; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return nullptr;
+        }
+        if (pid == 0) {
+            rank = r;
+            workers.clear();
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    // Keep only this rank's ends
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (i != rank && sockets[i][j] >= 0) close(sockets[i][j]);
+        }
+    }
+    return unique_ptr<SocketTransport>(new SocketTransport(rank, sockets[rank], workers));
+}
+
+SocketTransport::SocketTransport(int rank, const vector<int> &peers, const vector<int> &workers)
+    : myRank(rank), peers(peers), workers(workers) {}
+
+SocketTransport::~SocketTransport() {
+    for (int fd : peers) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool SocketTransport::waitForWorkers() {
+    bool ok = true;
+    for (pid_t pid : workers) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "Worker " << pid << " failed" << endl;
+            ok = false;
+        }
+    }
+    workers.clear();
+    return ok;
+}
+
+bool SocketTransport::exchange(int peer, const char *data, size_t size, vector<char> &in) {
+    int fd = peers[peer];
+    Transfer sending, receiving;
+    sending.length = size;
+    sending.payload = data;
+    in.clear();
+
+    // Interleave both directions so neither side fills its socket buffer and
+    // waits on a peer that is itself stuck writing
+    while (!sending.finished() || !receiving.finished()) {
+        pollfd request = { fd, 0, 0 };
+        if (!sending.finished()) request.events |= POLLOUT;
+        if (!receiving.finished()) request.events |= POLLIN;
+        if (poll(&request, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return false;
+        }
+        if ((request.revents & POLLOUT) && !writeSome(fd, sending, MSG_DONTWAIT)) return false;
+        if ((request.revents & POLLIN) && !readSome(fd, receiving, in, MSG_DONTWAIT)) return false;
+        if (request.revents & (POLLERR | POLLNVAL)) return false;
+        if ((request.revents & POLLHUP) && !(request.revents & POLLIN)) return false;
+    }
+    return true;
+}
+
+bool SocketTransport::send(int peer, const char *data, size_t size) {
+    Transfer sending;
+    sending.length = size;
+    sending.payload = data;
+    while (!sending.finished()) {
+        if (!writeSome(peers[peer], sending, 0)) return false;
+    }
+    return true;
+}
+
+bool SocketTransport::receive(int peer, vector<char> &message) {
+    Transfer receiving;
+    message.clear();
+    while (!receiving.finished()) {
+        if (!readSome(peers[peer], receiving, message, 0)) return false;
+    }
+    return true;
+}
+
+#else
+
+unique_ptr<SocketTransport> SocketTransport::launch(int size) {
+    cerr << "Multi-process runs need fork and Unix domain sockets, which this platform lacks" << endl;
+    return nullptr;
+}
+
+SocketTransport::~SocketTransport() {
+}
+
+bool SocketTransport::waitForWorkers() {
+    return false;
+}
+
+bool SocketTransport::exchange(int peer, const char *data, size_t size, vector<char> &in) {
+    return false;
+}
+
+bool SocketTransport::send(int peer, const char *data, size_t size) {
+    return false;
+}
+
+bool SocketTransport::receive(int peer, vector<char> &message) {
+    return false;
+}
+
+#endif
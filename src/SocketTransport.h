@@ -0,0 +1,40 @@
+#ifndef SOCKETTRANSPORT_H
+#define SOCKETTRANSPORT_H
+
+#include <memory>
+#include <vector>
+
+#include "Transport.h"
+
+// Transport over a full mesh of Unix domain socket pairs between processes
+// forked on the same machine. Messages are length prefixed. Not available
+// on Windows, where launch() always fails.
+class SocketTransport : public Transport {
+public:
+    ~SocketTransport();
+
+    // Forks size - 1 worker processes and returns the transport for the
+    // calling process, which is rank 0 in the parent. Returns null if the
+    // sockets or processes could not be created.
+    static std::unique_ptr<SocketTransport> launch(int size);
+
+    // Called by rank 0 once its own work is done to reap the workers.
+    // Returns false if any of them failed.
+    bool waitForWorkers();
+
+    int rank() const override { return myRank; }
+    int size() const override { return (int)peers.size(); }
+
+    bool exchange(int peer, const char *data, size_t size, std::vector<char> &in) override;
+    bool send(int peer, const char *data, size_t size) override;
+    bool receive(int peer, std::vector<char> &message) override;
+
+private:
+    SocketTransport(int rank, const std::vector<int> &peers, const std::vector<int> &workers);
+
+    int myRank;
+    std::vector<int> peers;   // socket to each rank, -1 for our own
+    std::vector<int> workers; // worker process ids, only filled in on rank 0
+};
+
+#endif // SOCKETTRANSPORT_H
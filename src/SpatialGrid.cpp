@@ -0,0 +1,144 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+
+void SpatialGrid::build(const std::vector<glm::vec3> &positions) {
+    rebuild(positions, nullptr);
+}
+
+void SpatialGrid::update(const std::vector<glm::vec3> &positions) {
+    patch(positions, nullptr);
+}
+
+void SpatialGrid::update(const std::vector<glm::vec3> &positions, const std::vector<int> &buckets) {
+    patch(positions, buckets.size() == positions.size() ? buckets.data() : nullptr);
+}
+
+void SpatialGrid::rebuild(const std::vector<glm::vec3> &positions, const int *keys) {
+    int numParticles = (int)positions.size();
+    int buckets = bucketsFor(numParticles);
+
+    // Still count the movers when the layout is unchanged so update() can
+    // tell when the particles have calmed down enough to patch again
+    bool sameLayout = !layoutChanged && numParticles == (int)particleBucket.size() && buckets == numBuckets();
+    movedCount = sameLayout ? 0 : numParticles;
+
+    // Precomputed buckets only hold for the layout they were computed in
+    if (layoutChanged || buckets != numBuckets()) {
+        keys = nullptr;
+    }
+
+    resizeBuffer(particleBucket, numParticles, heap);
+    for (int i = 0; i < numParticles; i++) {
+        int bucket = keys ? keys[i] : bucketOf(positions[i].x, positions[i].y);
+        movedCount += sameLayout && bucket != particleBucket[i];
+        particleBucket[i] = bucket;
+    }
+
+    sortByBucket(buckets);
+    layoutChanged = false;
+    incremental = false;
+}
+
+void SpatialGrid::reserve(int numParticles) {
+    int buckets = bucketsFor(numParticles);
+    reserveBuffer(particleBucket, numParticles, heap);
+    reserveBuffer(particleSlot, numParticles, heap);
+    reserveBuffer(bucketStart, buckets + 1, heap);
+    reserveBuffer(bucketSize, buckets, heap);
+    // Upper bound of the slack laid out by sortByBucket()
+    reserveBuffer(entries, numParticles + numParticles / 4 + 2 * buckets, heap);
+
+    // bucketsFor() sizes the table too, so put back the one in use
+    bucketsFor((int)particleBucket.size());
+}
+
+void SpatialGrid::sortByBucket(int buckets) {
+    int numParticles = (int)particleBucket.size();
+
+    resizeBuffer(bucketStart, buckets + 1, heap);
+    resizeBuffer(bucketSize, buckets, heap);
+    resizeBuffer(particleSlot, numParticles, heap);
+    std::fill(bucketSize.begin(), bucketSize.end(), 0);
+
+    // Count particles per bucket
+    for (int i = 0; i < numParticles; i++) {
+        bucketSize[particleBucket[i]]++;
+    }
+
+    // Lay the buckets out with a quarter of their size as slack, plus two
+    // slots so that sparse buckets can take particles too
+    int offset = 0;
+    for (int b = 0; b < buckets; b++) {
+        bucketStart[b] = offset;
+        offset += bucketSize[b] + bucketSize[b] / 4 + 2;
+        bucketSize[b] = 0;
+    }
+    bucketStart[buckets] = offset;
+    resizeBuffer(entries, offset, heap);
+
+    for (int i = 0; i < numParticles; i++) {
+        int bucket = particleBucket[i];
+        int slot = bucketStart[bucket] + bucketSize[bucket]++;
+        entries[slot] = i;
+        particleSlot[i] = slot;
+    }
+}
+
+bool SpatialGrid::moveParticle(int particle, int bucket) {
+    if (bucketStart[bucket] + bucketSize[bucket] == bucketStart[bucket + 1]) {
+        return false;
+    }
+
+    // Fill the hole with the last particle of the old bucket
+    int oldBucket = particleBucket[particle];
+    int last = bucketStart[oldBucket] + --bucketSize[oldBucket];
+    int slot = particleSlot[particle];
+    entries[slot] = entries[last];
+    particleSlot[entries[slot]] = slot;
+
+    slot = bucketStart[bucket] + bucketSize[bucket]++;
+    entries[slot] = particle;
+    particleSlot[particle] = slot;
+    particleBucket[particle] = bucket;
+    return true;
+}
+
+void SpatialGrid::patch(const std::vector<glm::vec3> &positions, const int *keys) {
+    int numParticles = (int)positions.size();
+    int limit = (int)(maxIncrementalFraction * numParticles);
+
+    // Splashing scenes move too many particles to patch, so keep rebuilding
+    // until the last step's movers drop under the limit
+    if (layoutChanged || movedCount > limit || numParticles != (int)particleBucket.size() ||
+        bucketsFor(numParticles) != numBuckets()) {
+        rebuild(positions, keys);
+        return;
+    }
+
+    // Patch movers in place until there are too many of them or a bucket
+    // overflows
+    movedCount = 0;
+    incremental = true;
+    int i = 0;
+    for (; i < numParticles && incremental; i++) {
+        int bucket = keys ? keys[i] : bucketOf(positions[i].x, positions[i].y);
+        if (bucket == particleBucket[i]) continue;
+        incremental = ++movedCount <= limit && moveParticle(i, bucket);
+        particleBucket[i] = bucket;
+    }
+    if (incremental) return;
+
+    // Then stop patching, bin the rest and sort them all as a build would
+    for (; i < numParticles; i++) {
+        int bucket = keys ? keys[i] : bucketOf(positions[i].x, positions[i].y);
+        movedCount += bucket != particleBucket[i];
+        particleBucket[i] = bucket;
+    }
+    sortByBucket(numBuckets());
+}
+
+size_t SpatialGrid::memoryUsage() const {
+    return (bucketStart.capacity() + bucketSize.capacity() + entries.capacity() +
+            particleBucket.capacity() + particleSlot.capacity()) * sizeof(int);
+}
@@ -0,0 +1,116 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FrameArena.h"
+
+// Neighbor-query interface shared by the grid backends. Particles are binned
+// into buckets with a counting sort so each bucket is a contiguous run of
+// particle indices, followed by a little slack so update() can move particles
+// between buckets without shifting the others. A bucket is a cell for the
+// dense grid and a hash slot for the hashed grid; either way the 3x3 block of
+// buckets around a point holds every particle within one cell size of it.
+class SpatialGrid {
+public:
+    virtual ~SpatialGrid() {}
+
+    virtual const char *name() const = 0;
+
+    // Cell edge length, normally the kernel radius
+    void setCellSize(float size) {
+        layoutChanged = layoutChanged || size != cellSize;
+        cellSize = size;
+    }
+    float getCellSize() const { return cellSize; }
+
+    // Bins every position. Must be called before any query.
+    void build(const std::vector<glm::vec3> &positions);
+
+    // Makes room for up to numParticles, so builds and updates below that
+    // never allocate
+    void reserve(int numParticles);
+
+    // Rebins only the particles whose bucket changed since the last build or
+    // update, moving each into the slack of its new bucket. Falls back to a
+    // full build when the layout changed, too many particles moved or a
+    // bucket ran out of slack.
+    void update(const std::vector<glm::vec3> &positions);
+    // Same, with bucketOf() of every position already worked out under the
+    // current layout. The buckets are ignored if the layout changes.
+    void update(const std::vector<glm::vec3> &positions, const std::vector<int> &buckets);
+
+    // Fraction of particles allowed to change buckets before update() gives
+    // up and does a full build instead
+    void setMaxIncrementalFraction(float fraction) { maxIncrementalFraction = fraction; }
+
+    // Particles that changed buckets in the last update(), and whether it
+    // managed to patch them in place
+    int getMovedCount() const { return movedCount; }
+    bool wasIncremental() const { return incremental; }
+
+    // Writes the distinct buckets of the 3x3 cells around (x, y) into out and
+    // returns how many were written
+    virtual int neighborBuckets(float x, float y, int out[9]) const = 0;
+
+    virtual int bucketOf(float x, float y) const = 0;
+
+    int numBuckets() const { return (int)bucketStart.size() - 1; }
+    const int *bucketBegin(int bucket) const { return entries.data() + bucketStart[bucket]; }
+    const int *bucketEnd(int bucket) const { return entries.data() + bucketStart[bucket] + bucketSize[bucket]; }
+
+    // Calls visit(particleIndex) for every particle in the buckets around (x, y)
+    template <typename Visitor>
+    void forEachNeighbor(float x, float y, Visitor visit) const {
+        int buckets[9];
+        int count = neighborBuckets(x, y, buckets);
+        for (int b = 0; b < count; b++) {
+            for (const int *it = bucketBegin(buckets[b]); it != bucketEnd(buckets[b]); ++it) {
+                visit(*it);
+            }
+        }
+    }
+
+    // Bytes held by the bucket table and particle lists
+    size_t memoryUsage() const;
+
+    // Times the grid had to grow its buffers
+    const HeapCounter &heapAllocations() const { return heap; }
+
+protected:
+    // Sizes the bucket table for numParticles particles and returns its size
+    virtual int bucketsFor(int numParticles) = 0;
+
+    float cellSize = 1.0f;
+
+    // Set when the cell size or bounds change so update() rebuilds
+    bool layoutChanged = true;
+
+    HeapCounter heap;
+
+    std::vector<int> bucketStart;    // numBuckets + 1 offsets into entries
+    std::vector<int> bucketSize;     // particles in each bucket, the rest is slack
+    std::vector<int> entries;        // particle indices grouped by bucket
+    std::vector<int> particleBucket; // bucket of each particle
+    std::vector<int> particleSlot;   // position of each particle in entries
+
+private:
+    // build() and update() taking optional precomputed buckets
+    void rebuild(const std::vector<glm::vec3> &positions, const int *keys);
+    void patch(const std::vector<glm::vec3> &positions, const int *keys);
+
+    // Counting sort of all particles by particleBucket
+    void sortByBucket(int buckets);
+
+    // Moves a particle from its current bucket into another one. Returns
+    // false without changing anything if the new bucket has no slack left.
+    bool moveParticle(int particle, int bucket);
+
+    float maxIncrementalFraction = 0.1f;
+    int movedCount = 0;
+    bool incremental = false;
+};
+
+#endif // SPATIALGRID_H
@@ -0,0 +1,40 @@
+#include "SpatialHashGrid.h"
+
+#include <cmath>
+
+int SpatialHashGrid::hashCell(int xCell, int yCell) const {
+    unsigned int h = (unsigned int)xCell * 73856093u ^ (unsigned int)yCell * 19349663u;
+    return (int)(h & (unsigned int)tableMask);
+}
+
+int SpatialHashGrid::bucketOf(float x, float y) const {
+    return hashCell((int)floor(x / cellSize), (int)floor(y / cellSize));
+}
+
+int SpatialHashGrid::neighborBuckets(float x, float y, int out[9]) const {
+    int xCell = (int)floor(x / cellSize);
+    int yCell = (int)floor(y / cellSize);
+
+    int count = 0;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int bucket = hashCell(xCell + dx, yCell + dy);
+
+            // Colliding cells would otherwise visit the same particles twice
+            bool seen = false;
+            for (int k = 0; k < count; k++) {
+                seen = seen || out[k] == bucket;
+            }
+            if (!seen) out[count++] = bucket;
+        }
+    }
+    return count;
+}
+
+int SpatialHashGrid::bucketsFor(int numParticles) {
+    // Power of two at least twice the particle count keeps chains short
+    int size = 1;
+    while (size < 2 * numParticles) size <<= 1;
+    tableMask = size - 1;
+    return size;
+}
@@ -0,0 +1,26 @@
+#ifndef SPATIALHASHGRID_H
+#define SPATIALHASHGRID_H
+
+#include "SpatialGrid.h"
+
+// Unbounded grid that hashes cell coordinates into a table sized by the
+// particle count, so memory is O(N) whatever the domain size. Cells that
+// collide share a bucket; callers already reject particles by distance, and
+// neighborBuckets never returns the same bucket twice.
+class SpatialHashGrid : public SpatialGrid {
+public:
+    const char *name() const override { return "hash"; }
+
+    int bucketOf(float x, float y) const override;
+    int neighborBuckets(float x, float y, int out[9]) const override;
+
+protected:
+    int bucketsFor(int numParticles) override;
+
+private:
+    int hashCell(int xCell, int yCell) const;
+
+    int tableMask = 0;
+};
+
+#endif // SPATIALHASHGRID_H
@@ -0,0 +1,81 @@
+#include "SurfaceBenchmark.h"
+#include "BenchmarkSetup.h"
+#include "Simulation.h"
+#include "SurfaceExtractor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+double timeExtract(SurfaceExtractor &surface, const Simulation &sim) {
+    auto start = chrono::high_resolution_clock::now();
+    surface.extract(sim.water, sim.width, sim.height, *sim.scheduler);
+    return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+} // namespace
+
+int runSurfaceBenchmark(int numWaterDrops, int steps, const string &outputFile) {
+    Simulation sim;
+    sim.gravity = glm::vec3(0, -4, 0);
+    warmUpSimulation(sim, numWaterDrops);
+
+    cout << "Surface benchmark: " << numWaterDrops << " drops, " << steps << " steps, "
+         << sim.scheduler->getThreadCount() << " threads" << endl;
+
+    // Times extracting after each call of advance, incrementally and from
+    // scratch
+    SurfaceExtractor incremental, full;
+    auto compare = [&](const char *label, const function<void()> &advance) {
+        incremental.extract(sim.water, sim.width, sim.height, *sim.scheduler);
+        double incrementalMs = 0, fullMs = 0;
+        long dirtyTiles = 0;
+        int fullRebuilds = 0;
+        for (int i = 0; i < steps; i++) {
+            advance();
+            incrementalMs += timeExtract(incremental, sim);
+            dirtyTiles += incremental.getDirtyTileCount();
+            fullRebuilds += incremental.wasFullRebuild();
+            full.invalidate();
+            fullMs += timeExtract(full, sim);
+        }
+        cout << fixed << setprecision(3) << label << ": full ms " << fullMs / steps << ", incremental ms "
+             << incrementalMs / steps << " (" << setprecision(1) << 100.0 * dirtyTiles / steps / incremental.getTileCount()
+             << "% of " << incremental.getTileCount() << " tiles redone, " << fullRebuilds << " full rebuilds), "
+             << full.getSegments().size() / 2 << " segments" << endl;
+    };
+
+    // Every drop moving with the simulation
+    compare("simulating", [&] { sim.step(benchmarkDeltaTime); });
+
+    // A settled scene with a local disturbance: the simulation stops and
+    // the 0.1% of the drops nearest the middle of the box jiggle by a few
+    // tolerances each frame
+    int moving = std::max(1, numWaterDrops / 1000);
+    vector<int> nearest(sim.water.size());
+    iota(nearest.begin(), nearest.end(), 0);
+    auto distance = [&](int i) { return glm::dot(sim.water[i].position, sim.water[i].position); };
+    partial_sort(nearest.begin(), nearest.begin() + moving, nearest.end(),
+                 [&](int a, int b) { return distance(a) < distance(b); });
+    mt19937 random(1);
+    uniform_real_distribution<float> nudge(-0.1f, 0.1f);
+    compare("settled, 0.1% moving", [&] {
+        for (int i = 0; i < moving; i++) {
+            sim.water[nearest[i]].position += glm::vec3(nudge(random), nudge(random), 0);
+        }
+    });
+
+    if (!outputFile.empty() && !incremental.writeObj(outputFile)) {
+        return 1;
+    }
+    return 0;
+}
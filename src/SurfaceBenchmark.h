@@ -0,0 +1,12 @@
+#ifndef SURFACEBENCHMARK_H
+#define SURFACEBENCHMARK_H
+
+#include <string>
+
+// Steps a simulation of numWaterDrops and extracts its surface after every
+// step, timing the incremental SurfaceExtractor against one that redoes
+// every tile, and writes the last contour to outputFile as an OBJ unless
+// it is empty. Needs no window.
+int runSurfaceBenchmark(int numWaterDrops, int steps = 60, const std::string &outputFile = "");
+
+#endif // SURFACEBENCHMARK_H
@@ -0,0 +1,315 @@
+#include "SurfaceExtractor.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Cell edges: 0 bottom, 1 right, 2 top, 3 left. The pairs of edges each
+// marching squares case joins, indexed by which corners are inside (bit 0
+// lower left, then counterclockwise). The saddles 5 and 10 list the pairs
+// used when the cell's centre is outside; inside they join the other way.
+const int caseEdges[16][4] = {
+    { -1, -1, -1, -1 }, { 3, 0, -1, -1 }, { 0, 1, -1, -1 }, { 3, 1, -1, -1 },
+    { 1, 2, -1, -1 },   { 3, 0, 1, 2 },   { 0, 2, -1, -1 }, { 3, 2, -1, -1 },
+    { 2, 3, -1, -1 },   { 0, 2, -1, -1 }, { 0, 1, 2, 3 },   { 1, 2, -1, -1 },
+    { 3, 1, -1, -1 },   { 0, 1, -1, -1 }, { 3, 0, -1, -1 }, { -1, -1, -1, -1 },
+};
+const vec2 cornerOffsets[4] = { vec2(0, 0), vec2(1, 0), vec2(1, 1), vec2(0, 1) };
+
+const int saddleEdges[16][4] = {
+    {}, {}, {}, {}, {}, { 0, 1, 2, 3 }, {}, {}, {}, {}, { 3, 0, 1, 2 }, {}, {}, {}, {}, {},
+};
+
+} // namespace
+
+void SurfaceExtractor::extract(const vector<WaterDrop> &water, float width, float height, TaskScheduler &scheduler) {
+    TraceSpan span("surface", "surface", "drops", (long long)water.size());
+    bool changed = tilesX == 0 || width != builtWidth || height != builtHeight || cellSize != builtCellSize ||
+                   radius != builtRadius || isoLevel != builtIsoLevel || tileCells != builtTileCells ||
+                   (int)water.size() != builtDrops;
+    if (changed) {
+        resize((int)water.size(), width, height);
+    }
+    fullRebuild = changed || !markMoved(water);
+    if (fullRebuild) {
+        fill(dirtyTiles.begin(), dirtyTiles.end(), 1);
+        for (size_t i = 0; i < water.size(); i++) {
+            splatPositions[i] = vec2(water[i].position);
+        }
+    }
+
+    dirtyTasks.clear();
+    contourTasks.clear();
+    for (int tile = 0; tile < getTileCount(); tile++) {
+        if (dirtyTiles[tile]) dirtyTasks.push_back({ tile, tile + 1, 1 });
+    }
+    if (dirtyTasks.empty()) return;
+
+    binDrops(water);
+    for (Task &task : dirtyTasks) {
+        task.weight += tileStarts[task.begin + 1] - tileStarts[task.begin];
+    }
+    scheduler.run(dirtyTasks, [&](const Task &task, int) {
+        depositTile(task.begin);
+    });
+    // Smoothing reads the neighbors' nodes, so waits for every deposit
+    scheduler.run(dirtyTasks, [&](const Task &task, int) {
+        smoothTile(task.begin);
+    });
+
+    // A tile's top and right cells read nodes owned by the tiles above and
+    // to the right, so those changing redoes its contour too
+    for (int ty = 0; ty < tilesY && !fullRebuild; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int tile = ty * tilesX + tx;
+            bool right = tx + 1 < tilesX;
+            bool up = ty + 1 < tilesY;
+            if (dirtyTiles[tile] || (right && dirtyTiles[tile + 1]) || (up && dirtyTiles[tile + tilesX]) ||
+                (right && up && dirtyTiles[tile + tilesX + 1])) {
+                contourTasks.push_back({ tile, tile + 1, cellsPerTile * cellsPerTile });
+            }
+        }
+    }
+    if (fullRebuild) {
+        contourTasks = dirtyTasks;
+    }
+    scheduler.run(contourTasks, [&](const Task &task, int) {
+        contourTile(task.begin);
+    });
+    fill(dirtyTiles.begin(), dirtyTiles.end(), 0);
+
+    segments.clear();
+    for (const vector<vec2> &tile : tileSegments) {
+        segments.insert(segments.end(), tile.begin(), tile.end());
+    }
+    revision++;
+}
+
+void SurfaceExtractor::resize(int numDrops, float width, float height) {
+    builtWidth = width;
+    builtHeight = height;
+    builtCellSize = cellSize;
+    builtRadius = radius;
+    builtIsoLevel = isoLevel;
+    builtTileCells = tileCells;
+    builtDrops = numDrops;
+
+    // A margin of a splat and a cell past the walls keeps the contour closed
+    // where the fluid touches them
+    float margin = radius + cellSize;
+    origin = vec2(-width / 2 - margin, -height / 2 - margin);
+    nodesX = (int)ceil((width + 2 * margin) / cellSize) + 1;
+    nodesY = (int)ceil((height + 2 * margin) / cellSize) + 1;
+    cellsPerTile = std::max(tileCells, (int)ceil(radius / cellSize));
+    tilesX = (nodesX - 2) / cellsPerTile + 1;
+    tilesY = (nodesY - 2) / cellsPerTile + 1;
+
+    field.assign(nodesX * nodesY, 0.0f);
+    mass.assign(nodesX * nodesY, 0.0f);
+
+    float reach = radius / cellSize;
+    stencilReach = (int)reach;
+    int side = 2 * stencilReach + 1;
+    stencil.resize(side * side);
+    for (int y = 0; y < side; y++) {
+        for (int x = 0; x < side; x++) {
+            float dx = x - stencilReach;
+            float dy = y - stencilReach;
+            float q = std::max(1 - (dx * dx + dy * dy) / (reach * reach), 0.0f);
+            stencil[y * side + x] = q * q * q;
+        }
+    }
+    dirtyTiles.assign(getTileCount(), 1);
+    tileSegments.resize(getTileCount());
+    splatPositions.resize(numDrops);
+}
+
+int SurfaceExtractor::tileOf(vec2 position) const {
+    vec2 cell = (position - origin) / cellSize;
+    int tx = std::min(std::max((int)cell.x / cellsPerTile, 0), tilesX - 1);
+    int ty = std::min(std::max((int)cell.y / cellsPerTile, 0), tilesY - 1);
+    return ty * tilesX + tx;
+}
+
+void SurfaceExtractor::tileNodes(int tile, int &x0, int &x1, int &y0, int &y1) const {
+    int tx = tile % tilesX;
+    int ty = tile / tilesX;
+    x0 = tx * cellsPerTile;
+    y0 = ty * cellsPerTile;
+    // The last tile of a row or column also owns the far edge's nodes
+    x1 = tx + 1 < tilesX ? x0 + cellsPerTile : nodesX;
+    y1 = ty + 1 < tilesY ? y0 + cellsPerTile : nodesY;
+}
+
+int SurfaceExtractor::markAround(vec2 position) {
+    int tile = tileOf(position);
+    int tx = tile % tilesX;
+    int ty = tile / tilesX;
+    int marked = 0;
+    for (int y = std::max(ty - 1, 0); y <= std::min(ty + 1, tilesY - 1); y++) {
+        for (int x = std::max(tx - 1, 0); x <= std::min(tx + 1, tilesX - 1); x++) {
+            marked += !dirtyTiles[y * tilesX + x];
+            dirtyTiles[y * tilesX + x] = 1;
+        }
+    }
+    return marked;
+}
+
+bool SurfaceExtractor::markMoved(const vector<WaterDrop> &water) {
+    float tolerance = moveFraction * radius;
+    tolerance *= tolerance;
+    int limit = (int)(fullRebuildFraction * getTileCount());
+    int marked = 0;
+    for (size_t i = 0; i < water.size(); i++) {
+        vec2 position = vec2(water[i].position);
+        vec2 offset = position - splatPositions[i];
+        if (dot(offset, offset) <= tolerance) continue;
+        marked += markAround(splatPositions[i]);
+        marked += markAround(position);
+        splatPositions[i] = position;
+        if (marked > limit) return false;
+    }
+    return true;
+}
+
+void SurfaceExtractor::binDrops(const vector<WaterDrop> &water) {
+    dropTiles.resize(water.size());
+    tileDrops.resize(water.size());
+    tileStarts.assign(getTileCount() + 1, 0);
+    for (size_t i = 0; i < water.size(); i++) {
+        dropTiles[i] = tileOf(vec2(water[i].position));
+        tileStarts[dropTiles[i] + 1]++;
+    }
+    for (int tile = 0; tile < getTileCount(); tile++) {
+        tileStarts[tile + 1] += tileStarts[tile];
+    }
+    // Filling back to front from each tile's end leaves tileStarts[t + 1]
+    // at tile t's start, so shift it down one afterwards. Drops keep their
+    // index order within a tile.
+    for (int i = (int)water.size() - 1; i >= 0; i--) {
+        tileDrops[--tileStarts[dropTiles[i] + 1]] = (vec2(water[i].position) - origin) / cellSize;
+    }
+    for (int tile = 0; tile < getTileCount(); tile++) {
+        tileStarts[tile] = tileStarts[tile + 1];
+    }
+    tileStarts[getTileCount()] = (int)water.size();
+}
+
+void SurfaceExtractor::depositTile(int tile) {
+    int x0, x1, y0, y1;
+    tileNodes(tile, x0, x1, y0, y1);
+    for (int y = y0; y < y1; y++) {
+        fill(mass.begin() + y * nodesX + x0, mass.begin() + y * nodesX + x1, 0.0f);
+    }
+
+    // A drop reaches the nodes at the corners of its cell, so only drops in
+    // this tile and the ones below and to the left land here
+    int tx = tile % tilesX;
+    int ty = tile / tilesX;
+    for (int ny = std::max(ty - 1, 0); ny <= ty; ny++) {
+        for (int nx = std::max(tx - 1, 0); nx <= tx; nx++) {
+            int neighbor = ny * tilesX + nx;
+            for (int k = tileStarts[neighbor]; k < tileStarts[neighbor + 1]; k++) {
+                vec2 position = tileDrops[k];
+                int x = std::min((int)position.x, nodesX - 2);
+                int y = std::min((int)position.y, nodesY - 2);
+                float fx = position.x - x;
+                float fy = position.y - y;
+                float weights[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+                for (int corner = 0; corner < 4; corner++) {
+                    int cx = x + (corner & 1);
+                    int cy = y + (corner >> 1);
+                    if (cx >= x0 && cx < x1 && cy >= y0 && cy < y1) {
+                        mass[cy * nodesX + cx] += weights[corner];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SurfaceExtractor::smoothTile(int tile) {
+    int x0, x1, y0, y1;
+    tileNodes(tile, x0, x1, y0, y1);
+    int reach = stencilReach;
+    int side = 2 * reach + 1;
+    for (int y = y0; y < y1; y++) {
+        int bottom = std::max(y - reach, 0);
+        int top = std::min(y + reach, nodesY - 1);
+        for (int x = x0; x < x1; x++) {
+            int left = std::max(x - reach, 0);
+            int right = std::min(x + reach, nodesX - 1);
+            float sum = 0;
+            for (int sy = bottom; sy <= top; sy++) {
+                const float *row = &mass[sy * nodesX + left];
+                const float *weights = &stencil[(sy - y + reach) * side + left - x + reach];
+                for (int i = 0; i <= right - left; i++) {
+                    sum += row[i] * weights[i];
+                }
+            }
+            field[y * nodesX + x] = sum;
+        }
+    }
+}
+
+void SurfaceExtractor::contourTile(int tile) {
+    vector<vec2> &out = tileSegments[tile];
+    out.clear();
+
+    int x0, x1, y0, y1;
+    tileNodes(tile, x0, x1, y0, y1);
+    // Cells, unlike nodes, stop one short of the far edge
+    x1 = std::min(x1, nodesX - 1);
+    y1 = std::min(y1, nodesY - 1);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            float corners[4] = { field[y * nodesX + x], field[y * nodesX + x + 1],
+                                 field[(y + 1) * nodesX + x + 1], field[(y + 1) * nodesX + x] };
+            int index = (corners[0] >= isoLevel) | (corners[1] >= isoLevel) << 1 |
+                        (corners[2] >= isoLevel) << 2 | (corners[3] >= isoLevel) << 3;
+            if (index == 0 || index == 15) continue;
+
+            const int *edges = caseEdges[index];
+            if ((index == 5 || index == 10) &&
+                (corners[0] + corners[1] + corners[2] + corners[3]) / 4 >= isoLevel) {
+                edges = saddleEdges[index];
+            }
+
+            vec2 corner = gridPoint(x, y);
+            for (int e = 0; e < 4 && edges[e] >= 0; e++) {
+                // Edge e runs from corner e to corner e + 1
+                int edge = edges[e];
+                float a = corners[edge];
+                float b = corners[(edge + 1) & 3];
+                float t = (isoLevel - a) / (b - a);
+                vec2 from = cornerOffsets[edge];
+                vec2 to = cornerOffsets[(edge + 1) & 3];
+                out.push_back(corner + (from + (to - from) * t) * cellSize);
+            }
+        }
+    }
+}
+
+bool SurfaceExtractor::writeObj(const string &file) const {
+    ofstream out(file);
+    if (!out.is_open()) {
+        cerr << "Could not open file: '" << file << "'" << endl;
+        return false;
+    }
+    out << "# " << segments.size() / 2 << " contour segments at iso level " << isoLevel << endl;
+    for (const vec2 &point : segments) {
+        out << "v " << point.x << " " << point.y << " 0" << endl;
+    }
+    for (size_t i = 0; i < segments.size(); i += 2) {
+        out << "l " << i + 1 << " " << i + 2 << endl;
+    }
+    return true;
+}
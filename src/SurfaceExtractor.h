@@ -0,0 +1,127 @@
+#ifndef SURFACEEXTRACTOR_H
+#define SURFACEEXTRACTOR_H
+
+#include "TaskScheduler.h"
+#include "WaterDrop.h"
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// The fluid surface as line segments: particles are splatted onto a regular
+// grid of density samples over the box, and the isoLevel contour of that
+// field is traced with marching squares. A splat is a bilinear deposit onto
+// the four nearest nodes, smoothed by the kernel sampled at whole node
+// offsets, so it costs a fixed amount per node however many drops there
+// are and lands within a cell of splatting each drop's kernel exactly.
+// The grid is split into square tiles that are splatted and contoured in
+// parallel on the scheduler, and only tiles within reach of a particle
+// that moved more than moveFraction of the radius since the last extract()
+// are redone, so a mostly settled scene costs little more than the binning
+// pass. Once more than fullRebuildFraction of the tiles would be redone,
+// tracking stops and every tile is redone without it.
+class SurfaceExtractor {
+public:
+    // Spacing of the density samples
+    float cellSize = 0.1f;
+    // Reach of a particle's splat, (1 - d^2 / radius^2)^3, which peaks at 1
+    float radius = 0.4f;
+    float isoLevel = 0.5f;
+    // Motion below this fraction of radius leaves a particle's tiles alone.
+    // The splat's steepest slope is about 1.7 / radius, so the cached field
+    // is off by at most 1.7 * moveFraction of a splat's peak per drop.
+    float moveFraction = 0.05f;
+    // Share of the tiles past which tracking motion costs more than it saves
+    float fullRebuildFraction = 0.5f;
+    // Cells along the side of a tile, raised if needed so a splat never
+    // reaches past the tiles next to the one its drop is in
+    int tileCells = 16;
+
+    // Brings the contour up to date with the drops in a width x height box
+    // centred on the origin. Changing the box, the settings or the number
+    // of drops redoes every tile.
+    void extract(const std::vector<WaterDrop> &water, float width, float height, TaskScheduler &scheduler);
+    // Forgets the cached field, so the next extract() redoes every tile
+    void invalidate() { tilesX = tilesY = 0; }
+
+    // Endpoints of the contour segments, two per segment
+    const std::vector<glm::vec2> &getSegments() const { return segments; }
+    // Bumped whenever getSegments() changes, for callers caching a copy
+    int getRevision() const { return revision; }
+
+    int getTileCount() const { return tilesX * tilesY; }
+    // Tiles resplatted by the last extract()
+    int getDirtyTileCount() const { return (int)dirtyTasks.size(); }
+    // Whether the last extract() redid every tile without tracking motion
+    bool wasFullRebuild() const { return fullRebuild; }
+
+    int getGridWidth() const { return nodesX; }
+    int getGridHeight() const { return nodesY; }
+    glm::vec2 gridPoint(int x, int y) const { return origin + glm::vec2(x, y) * cellSize; }
+    float gridValue(int x, int y) const { return field[y * nodesX + x]; }
+
+    // Writes the segments as OBJ line elements in the z = 0 plane
+    bool writeObj(const std::string &file) const;
+
+private:
+    void resize(int numDrops, float width, float height);
+    void binDrops(const std::vector<WaterDrop> &water);
+    // Marks the tiles of drops that moved, giving up and returning false
+    // once more than fullRebuildFraction of them are marked
+    bool markMoved(const std::vector<WaterDrop> &water);
+    int tileOf(glm::vec2 position) const;
+    // Returns how many tiles were newly marked
+    int markAround(glm::vec2 position);
+    // Node range [x0, x1) x [y0, y1) a tile owns
+    void tileNodes(int tile, int &x0, int &x1, int &y0, int &y1) const;
+    void depositTile(int tile);
+    void smoothTile(int tile);
+    void contourTile(int tile);
+
+    // Layout the cached field was built for
+    float builtWidth = 0;
+    float builtHeight = 0;
+    float builtCellSize = 0;
+    float builtRadius = 0;
+    float builtIsoLevel = 0;
+    int builtTileCells = 0;
+    int builtDrops = -1;
+
+    int cellsPerTile = 1;
+    glm::vec2 origin = glm::vec2(0, 0);
+    int nodesX = 0;
+    int nodesY = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+
+    // Deposited drops and smoothed density at each grid node, row-major. A
+    // tile owns the nodes of its cells' lower left corners.
+    std::vector<float> mass;
+    std::vector<float> field;
+
+    // Kernel weights at node offsets up to stencilReach, row-major
+    std::vector<float> stencil;
+    int stencilReach = 0;
+
+    // Drop positions in cells from the origin, sorted by the tile they fall
+    // in: tileStarts[t] to tileStarts[t + 1] index into tileDrops
+    std::vector<int> tileStarts;
+    std::vector<glm::vec2> tileDrops;
+    std::vector<int> dropTiles;
+
+    // Position each drop was last splatted from
+    std::vector<glm::vec2> splatPositions;
+
+    // Tiles whose nodes need depositing and smoothing, and tiles whose cells need
+    // contouring, which includes those reading a resplatted neighbor's nodes
+    std::vector<char> dirtyTiles;
+    std::vector<Task> dirtyTasks;
+    std::vector<Task> contourTasks;
+    bool fullRebuild = false;
+
+    std::vector<std::vector<glm::vec2>> tileSegments;
+    std::vector<glm::vec2> segments;
+    int revision = 0;
+};
+
+#endif // SURFACEEXTRACTOR_H
@@ -0,0 +1,161 @@
+#include "TaskScheduler.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+long currentThreadId() {
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+TaskScheduler::TaskScheduler(int numThreads)
+    : queues(std::max(1, numThreads)), stats(queues.size()), threadIds(queues.size()), busyWorkers(0) {
+    threadIds[0] = currentThreadId();
+    busyWorkers = (int)queues.size() - 1;
+    for (int worker = 1; worker < (int)queues.size(); worker++) {
+        threads.emplace_back(&TaskScheduler::workerLoop, this, worker);
+    }
+
+    // Wait for the workers to record their ids
+    while (busyWorkers.load() > 0) {
+        this_thread::yield();
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        lock_guard<mutex> guard(startLock);
+        stopping = true;
+    }
+    startSignal.notify_all();
+    for (thread &t : threads) {
+        t.join();
+    }
+}
+
+void TaskScheduler::resetStats() {
+    std::fill(stats.begin(), stats.end(), WorkerStats());
+}
+
+void TaskScheduler::run(const vector<Task> &tasks, Invoker invoke, void *context) {
+    int numWorkers = getThreadCount();
+
+    // Deal out contiguous runs of tasks, each close to an equal share of the
+    // total weight, so neighboring cells tend to stay on the same worker
+    long totalWeight = 0;
+    for (const Task &task : tasks) {
+        totalWeight += task.weight;
+    }
+    int next = 0;
+    long dealt = 0;
+    for (int worker = 0; worker < numWorkers; worker++) {
+        long share = totalWeight * (worker + 1) / numWorkers;
+        queues[worker].head = next;
+        while (next < (int)tasks.size() && (dealt < share || worker == numWorkers - 1)) {
+            dealt += tasks[next++].weight;
+        }
+        queues[worker].tail = next;
+    }
+
+    if (numWorkers == 1) {
+        currentTasks = &tasks;
+        currentInvoke = invoke;
+        currentContext = context;
+        work(0);
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(startLock);
+        currentTasks = &tasks;
+        currentInvoke = invoke;
+        currentContext = context;
+        busyWorkers = numWorkers;
+        generation++;
+    }
+    startSignal.notify_all();
+
+    work(0);
+    busyWorkers--;
+
+    // The workers must be done with tasks and body before they go away
+    while (busyWorkers.load() > 0) {
+        this_thread::yield();
+    }
+}
+
+void TaskScheduler::workerLoop(int worker) {
+    threadIds[worker] = currentThreadId();
+    nameTraceThread("worker " + to_string(worker));
+    busyWorkers--;
+
+    int seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> guard(startLock);
+            startSignal.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(worker);
+        busyWorkers--;
+    }
+}
+
+void TaskScheduler::work(int worker) {
+    WorkerStats &mine = stats[worker];
+    int task;
+    while (true) {
+        bool stolen = false;
+        if (!popOwn(worker, task)) {
+            if (!steal(worker, task)) return;
+            stolen = true;
+        }
+
+        auto start = chrono::high_resolution_clock::now();
+        {
+            const Task &current = (*currentTasks)[task];
+            TraceSpan span("task", "scheduler", "weight", current.weight);
+            currentInvoke(currentContext, current, worker);
+        }
+        mine.busyMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        mine.tasks++;
+        mine.steals += stolen;
+    }
+}
+
+bool TaskScheduler::popOwn(int worker, int &task) {
+    Queue &queue = queues[worker];
+    lock_guard<mutex> guard(queue.lock);
+    if (queue.head == queue.tail) return false;
+    task = queue.head++;
+    return true;
+}
+
+bool TaskScheduler::steal(int worker, int &task) {
+    int numWorkers = getThreadCount();
+    for (int offset = 1; offset < numWorkers; offset++) {
+        Queue &victim = queues[(worker + offset) % numWorkers];
+        lock_guard<mutex> guard(victim.lock);
+        if (victim.head != victim.tail) {
+            task = --victim.tail;
+            return true;
+        }
+    }
+    return false;
+}
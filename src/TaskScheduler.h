@@ -0,0 +1,91 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A range of work items, e.g. a block of grid buckets, with the weight used
+// to spread tasks over the workers up front
+struct Task {
+    int begin;
+    int end;
+    int weight;
+};
+
+// Work-stealing thread pool. Each run() deals the tasks out to the workers
+// as contiguous runs of roughly equal weight. Workers take tasks from the
+// front of their own queue, and once it is empty steal from the back of
+// the others', so tasks whose real cost differs from their weight still
+// balance out. The calling thread works as worker 0.
+class TaskScheduler {
+public:
+    struct WorkerStats {
+        double busyMs = 0;  // time spent running tasks
+        int tasks = 0;      // tasks run, including stolen ones
+        int steals = 0;     // tasks taken from another worker's queue
+    };
+
+    explicit TaskScheduler(int numThreads = std::thread::hardware_concurrency());
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    int getThreadCount() const { return (int)queues.size(); }
+
+    // Kernel thread id of each worker (0 where unknown), for tools that
+    // attach per thread such as the hardware counters. Worker 0 is the
+    // thread that constructed the scheduler.
+    const std::vector<long> &getThreadIds() const { return threadIds; }
+
+    // Calls body(task, worker) for every task and returns once all are done
+    template <typename Body>
+    void run(const std::vector<Task> &tasks, Body &&body) {
+        run(tasks, [](void *context, const Task &task, int worker) {
+            (*static_cast<typename std::remove_reference<Body>::type *>(context))(task, worker);
+        }, (void *)&body);
+    }
+
+    // Totals since the last resetStats()
+    const std::vector<WorkerStats> &getStats() const { return stats; }
+    void resetStats();
+
+private:
+    // Type-erased body, which unlike std::function never allocates
+    typedef void (*Invoker)(void *context, const Task &task, int worker);
+    void run(const std::vector<Task> &tasks, Invoker invoke, void *context);
+
+    // Task indices [head, tail) still waiting in a worker's queue
+    struct Queue {
+        std::mutex lock;
+        int head = 0;
+        int tail = 0;
+    };
+
+    void workerLoop(int worker);
+    void work(int worker);
+    bool popOwn(int worker, int &task);
+    bool steal(int worker, int &task);
+
+    std::vector<std::thread> threads;
+    std::vector<Queue> queues;
+    std::vector<WorkerStats> stats;
+    std::vector<long> threadIds;
+
+    // The run being worked on, published to the workers under startLock
+    const std::vector<Task> *currentTasks = nullptr;
+    Invoker currentInvoke = nullptr;
+    void *currentContext = nullptr;
+    std::mutex startLock;
+    std::condition_variable startSignal;
+    int generation = 0;
+    bool stopping = false;
+
+    std::atomic<int> busyWorkers;
+};
+
+#endif // TASKSCHEDULER_H
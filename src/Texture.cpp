@@ -10,7 +10,10 @@ using namespace std;
 
 Texture::Texture() :
 	filename(""),
-	tid(0)
+	width(0),
+	height(0),
+	tid(0),
+	unit(0)
 {
 	
 }
@@ -59,6 +62,31 @@ void Texture::init()
 	stbi_image_free(data);
 }
 
+void Texture::setData(int w, int h, int components, const float *data)
+{
+	GLenum format = components == 2 ? GL_RG : GL_RED;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if(tid && w == width && h == height) {
+		glBindTexture(GL_TEXTURE_2D, tid);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_FLOAT, data);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
+	if(!tid) {
+		glGenTextures(1, &tid);
+	}
+	width = w;
+	height = h;
+	glBindTexture(GL_TEXTURE_2D, tid);
+	glTexImage2D(GL_TEXTURE_2D, 0, components == 2 ? GL_RG32F : GL_R32F, width, height, 0, format, GL_FLOAT, data);
+	// One texel per grid node, so no mipmaps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void Texture::setWrapModes(GLint wrapS, GLint wrapT)
 {
 	// Must be called after init()
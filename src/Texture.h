@@ -12,6 +12,10 @@ public:
 	virtual ~Texture();
 	void setFilename(const std::string &f) { filename = f; }
 	void init();
+	// Creates or refills a float texture of width x height texels with
+	// components (1 or 2) channels each, for fields computed on the CPU.
+	// Takes the place of init(); reuses the storage while the size holds.
+	void setData(int width, int height, int components, const float *data);
 	void setUnit(GLint u) { unit = u; }
 	GLint getUnit() const { return unit; }
 	void bind(GLint handle);
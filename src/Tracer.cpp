@@ -0,0 +1,148 @@
+#include "Tracer.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Event {
+    const char *name;
+    const char *category;
+    const char *argName;
+    long long arg;
+    long long startNs;
+    long long durationNs;
+};
+
+// Written only by its own thread. count is the number of events ever
+// recorded, published with release so the writer sees complete events.
+// events is sized under buffersLock, at registration and by startTracing(),
+// never while its thread records.
+struct ThreadBuffer {
+    int id;
+    string name;
+    vector<Event> events;
+    atomic<size_t> count{0};
+};
+
+mutex buffersLock;
+vector<unique_ptr<ThreadBuffer>> buffers;
+// Guarded by buffersLock
+size_t capacity = 0;
+chrono::steady_clock::time_point epoch;
+
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+// Registers the calling thread on first use; the only step that locks or
+// allocates. Threads that register before startTracing(), like the
+// scheduler's workers, never allocate inside a span.
+ThreadBuffer &ownBuffer() {
+    if (!threadBuffer) {
+        lock_guard<mutex> guard(buffersLock);
+        buffers.emplace_back(new ThreadBuffer());
+        threadBuffer = buffers.back().get();
+        threadBuffer->id = (int)buffers.size() - 1;
+        threadBuffer->name = "thread " + to_string(threadBuffer->id);
+        threadBuffer->events.assign(capacity, Event());
+    }
+    return *threadBuffer;
+}
+
+} // namespace
+
+namespace tracing {
+
+atomic<bool> recording(false);
+
+void record(const char *name, const char *category, const char *argName, long long arg,
+            chrono::steady_clock::time_point start) {
+    auto end = chrono::steady_clock::now();
+    ThreadBuffer &buffer = ownBuffer();
+    if (buffer.events.empty()) return;
+
+    size_t count = buffer.count.load(memory_order_relaxed);
+    Event &event = buffer.events[count % buffer.events.size()];
+    event.name = name;
+    event.category = category;
+    event.argName = argName;
+    event.arg = arg;
+    event.startNs = chrono::duration_cast<chrono::nanoseconds>(start - epoch).count();
+    event.durationNs = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    buffer.count.store(count + 1, memory_order_release);
+}
+
+} // namespace tracing
+
+void startTracing(size_t eventsPerThread) {
+    {
+        lock_guard<mutex> guard(buffersLock);
+        capacity = eventsPerThread;
+        for (unique_ptr<ThreadBuffer> &buffer : buffers) {
+            buffer->events.assign(capacity, Event());
+            buffer->count.store(0, memory_order_relaxed);
+        }
+    }
+    epoch = chrono::steady_clock::now();
+    tracing::recording.store(true);
+}
+
+void stopTracing() {
+    tracing::recording.store(false);
+}
+
+bool isTracing() {
+    return tracing::recording.load();
+}
+
+void nameTraceThread(const string &name) {
+    ThreadBuffer &buffer = ownBuffer();
+    lock_guard<mutex> guard(buffersLock);
+    buffer.name = name;
+}
+
+bool writeTrace(const string &file) {
+    ofstream out(file);
+    if (!out) {
+        cerr << "Could not write trace to " << file << endl;
+        return false;
+    }
+
+    lock_guard<mutex> guard(buffersLock);
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    size_t written = 0;
+    for (const unique_ptr<ThreadBuffer> &buffer : buffers) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+            << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+        first = false;
+
+        size_t count = buffer->count.load(memory_order_acquire);
+        size_t size = buffer->events.size();
+        for (size_t i = count > size ? count - size : 0; i < count; i++) {
+            const Event &event = buffer->events[i % size];
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << event.startNs / 1000.0
+                << ",\"dur\":" << event.durationNs / 1000.0;
+            if (event.argName) {
+                out << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+            }
+            out << "}";
+            written++;
+        }
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        cerr << "Could not write trace to " << file << endl;
+        return false;
+    }
+    cout << "Wrote " << written << " trace events to " << file << endl;
+    return true;
+}
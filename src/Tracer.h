@@ -0,0 +1,58 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Records spans of time from any thread into per-thread ring buffers and
+// writes them as Chrome trace-event JSON, which chrome://tracing and
+// ui.perfetto.dev open. Off by default: a span costs one atomic load until
+// startTracing(). Each thread keeps its latest eventsPerThread spans, so a
+// long run keeps the end of the timeline. Names and categories must be
+// string literals or otherwise outlive the trace. startTracing() sizes every
+// registered thread's buffer, so call it while no other thread is
+// recording, e.g. between frames.
+void startTracing(size_t eventsPerThread = 1 << 16);
+void stopTracing();
+bool isTracing();
+
+// Writes the spans recorded since startTracing(). Call it while no other
+// thread is recording, e.g. between frames.
+bool writeTrace(const std::string &file);
+
+// Labels the calling thread's row in the trace, registering the thread so
+// its first span doesn't allocate its buffer
+void nameTraceThread(const std::string &name);
+
+namespace tracing {
+extern std::atomic<bool> recording;
+void record(const char *name, const char *category, const char *argName, long long arg,
+            std::chrono::steady_clock::time_point start);
+}
+
+// Records the time from construction to destruction as one span
+class TraceSpan {
+public:
+    TraceSpan(const char *name, const char *category, const char *argName = nullptr, long long arg = 0)
+        : name(name), category(category), argName(argName), arg(arg),
+          active(tracing::recording.load(std::memory_order_relaxed)) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+    ~TraceSpan() {
+        if (active) tracing::record(name, category, argName, arg, start);
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    const char *argName;
+    long long arg;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // TRACER_H
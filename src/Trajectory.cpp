@@ -0,0 +1,371 @@
+#include "Trajectory.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace glm;
+using namespace trajectory;
+
+namespace {
+
+const char headerMagic[8] = { 'F', 'L', 'U', 'I', 'D', 'T', 'R', 'J' };
+const char frameMagic[4] = { 'F', 'R', 'M', 'E' };
+const char footerMagic[8] = { 'F', 'L', 'U', 'I', 'D', 'I', 'D', 'X' };
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Array offsets of a frame of count drops
+TrajectoryFrameHeader frameLayout(uint32_t count) {
+    TrajectoryFrameHeader frame = {};
+    memcpy(frame.magic, frameMagic, sizeof(frameMagic));
+    frame.count = count;
+    uint64_t offset = alignUp(sizeof(TrajectoryFrameHeader), 16);
+    frame.positions = (uint32_t)offset;
+    offset = alignUp(offset + count * sizeof(vec2), 16);
+    frame.velocities = (uint32_t)offset;
+    offset = alignUp(offset + count * sizeof(vec2), 16);
+    frame.densities = (uint32_t)offset;
+    offset = alignUp(offset + count * sizeof(float), 16);
+    frame.radii = (uint32_t)offset;
+    offset = alignUp(offset + count * sizeof(float), 16);
+    frame.ids = (uint32_t)offset;
+    frame.size = offset + count * sizeof(int32_t);
+    return frame;
+}
+
+#ifndef _WIN32
+bool readAt(int fd, void *data, size_t size, uint64_t offset) {
+    return pread(fd, data, size, (off_t)offset) == (ssize_t)size;
+}
+#endif
+
+} // namespace
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const string &file, float width, float height) {
+    close();
+    out.open(file, ios::binary | ios::trunc);
+    if (!out.is_open()) {
+        cerr << "Could not open file: '" << file << "'" << endl;
+        return false;
+    }
+
+    TrajectoryHeader header = {};
+    memcpy(header.magic, headerMagic, sizeof(headerMagic));
+    header.version = trajectory::version;
+    header.pageSize = pageSize;
+    header.width = width;
+    header.height = height;
+    out.write((const char *)&header, sizeof(header));
+    offset = sizeof(header);
+    pad();
+
+    index.clear();
+    queued.clear();
+    states[0] = states[1] = Free;
+    stopping = false;
+    failed = !out;
+    framesWritten = 0;
+    framesDropped = 0;
+    bytesWritten = 0;
+    ioThread = thread(&TrajectoryWriter::ioLoop, this);
+    return true;
+}
+
+bool TrajectoryWriter::capture(const Simulation &sim, long long step, double time) {
+    int slot;
+    {
+        lock_guard<mutex> guard(lock);
+        slot = states[0] == Free ? 0 : states[1] == Free ? 1 : -1;
+        if (slot < 0) {
+            framesDropped++;
+            return false;
+        }
+    }
+
+    // The slot is free, so the I/O thread will not touch it until queued
+    Snapshot &snapshot = snapshots[slot];
+    size_t count = sim.water.size();
+    snapshot.positions.resize(count);
+    snapshot.velocities.resize(count);
+    snapshot.densities.resize(count);
+    snapshot.radii.resize(count);
+    snapshot.ids.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const WaterDrop &drop = sim.water[i];
+        snapshot.positions[i] = vec2(drop.position);
+        snapshot.velocities[i] = vec2(drop.velocity);
+        snapshot.densities[i] = i < sim.densities.size() ? sim.densities[i] : 0.0f;
+        snapshot.radii[i] = drop.radius;
+        snapshot.ids[i] = (int)i < sim.pool.size() ? sim.pool.idAt((int)i) : (int32_t)i;
+    }
+    snapshot.step = (uint64_t)step;
+    snapshot.time = time;
+    snapshot.targetDensity = sim.targetDensity;
+
+    {
+        lock_guard<mutex> guard(lock);
+        states[slot] = Queued;
+        queued.push_back(slot);
+    }
+    wake.notify_one();
+    return true;
+}
+
+void TrajectoryWriter::ioLoop() {
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [&] { return stopping || !queued.empty(); });
+        if (queued.empty()) return;
+
+        int slot = queued.front();
+        queued.erase(queued.begin());
+        states[slot] = Writing;
+        guard.unlock();
+        writeFrame(snapshots[slot]);
+        guard.lock();
+        states[slot] = Free;
+    }
+}
+
+void TrajectoryWriter::writeFrame(const Snapshot &snapshot) {
+    uint32_t count = (uint32_t)snapshot.positions.size();
+    TrajectoryFrameHeader frame = frameLayout(count);
+    frame.step = snapshot.step;
+    frame.time = snapshot.time;
+    frame.targetDensity = snapshot.targetDensity;
+
+    TrajectoryIndexEntry entry = {};
+    entry.offset = offset;
+    entry.size = frame.size;
+    entry.step = frame.step;
+    entry.time = frame.time;
+    entry.count = count;
+
+    // Arrays straight from the snapshot, with zeros up to each offset
+    static const char zeros[16] = {};
+    uint64_t written = 0;
+    auto writeAt = [&](uint64_t at, const void *data, size_t size) {
+        out.write(zeros, at - written);
+        out.write((const char *)data, size);
+        written = at + size;
+    };
+    writeAt(0, &frame, sizeof(frame));
+    writeAt(frame.positions, snapshot.positions.data(), count * sizeof(vec2));
+    writeAt(frame.velocities, snapshot.velocities.data(), count * sizeof(vec2));
+    writeAt(frame.densities, snapshot.densities.data(), count * sizeof(float));
+    writeAt(frame.radii, snapshot.radii.data(), count * sizeof(float));
+    writeAt(frame.ids, snapshot.ids.data(), count * sizeof(int32_t));
+    offset += written;
+    pad();
+
+    if (!out) {
+        failed = true;
+        return;
+    }
+    index.push_back(entry);
+    framesWritten++;
+    bytesWritten = (long long)offset;
+}
+
+void TrajectoryWriter::pad() {
+    static const char zeros[pageSize] = {};
+    uint64_t aligned = alignUp(offset, pageSize);
+    out.write(zeros, aligned - offset);
+    offset = aligned;
+}
+
+bool TrajectoryWriter::close() {
+    if (!isOpen()) return true;
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    ioThread.join();
+
+    TrajectoryFooter footer = {};
+    footer.indexOffset = offset;
+    footer.frameCount = index.size();
+    memcpy(footer.magic, footerMagic, sizeof(footerMagic));
+    out.write((const char *)index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+    out.write((const char *)&footer, sizeof(footer));
+    out.close();
+    bytesWritten = (long long)(offset + index.size() * sizeof(TrajectoryIndexEntry) + sizeof(footer));
+
+    if (failed || out.fail()) {
+        cerr << "Writing the trajectory failed after " << framesWritten << " frames" << endl;
+        return false;
+    }
+    return true;
+}
+
+TrajectoryReader::Frame::~Frame() {
+    release();
+}
+
+TrajectoryReader::Frame::Frame(Frame &&other) {
+    *this = std::move(other);
+}
+
+TrajectoryReader::Frame &TrajectoryReader::Frame::operator=(Frame &&other) {
+    if (this != &other) {
+        release();
+        mapping = other.mapping;
+        length = other.length;
+        frame = other.frame;
+        other.mapping = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+#ifndef _WIN32
+
+void TrajectoryReader::Frame::release() {
+    if (mapping) munmap(mapping, length);
+    mapping = nullptr;
+    length = 0;
+}
+
+void TrajectoryReader::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    index.clear();
+}
+
+bool TrajectoryReader::open(const string &file) {
+    close();
+    fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Could not open file: '" << file << "' (" << strerror(errno) << ")" << endl;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t fileSize = (uint64_t)info.st_size;
+
+    if (!readAt(fd, &header, sizeof(header), 0) || memcmp(header.magic, headerMagic, sizeof(headerMagic)) != 0 ||
+        header.version != trajectory::version || header.pageSize == 0) {
+        cerr << file << " is not a trajectory this build can read" << endl;
+        close();
+        return false;
+    }
+
+    TrajectoryFooter footer = {};
+    recovered = fileSize < sizeof(footer) || !readAt(fd, &footer, sizeof(footer), fileSize - sizeof(footer)) ||
+                memcmp(footer.magic, footerMagic, sizeof(footerMagic)) != 0 ||
+                footer.indexOffset + footer.frameCount * sizeof(TrajectoryIndexEntry) + sizeof(footer) != fileSize;
+    if (!recovered) {
+        index.resize(footer.frameCount);
+        if (!readAt(fd, index.data(), index.size() * sizeof(TrajectoryIndexEntry), footer.indexOffset)) {
+            recovered = true;
+        }
+    }
+    if (recovered && !rebuildIndex(fileSize)) {
+        cerr << file << " has no readable frames" << endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryReader::rebuildIndex(uint64_t fileSize) {
+    index.clear();
+    uint64_t offset = alignUp(sizeof(TrajectoryHeader), header.pageSize);
+    TrajectoryFrameHeader frame;
+    while (offset + sizeof(frame) <= fileSize && readAt(fd, &frame, sizeof(frame), offset) &&
+           memcmp(frame.magic, frameMagic, sizeof(frameMagic)) == 0 && offset + frame.size <= fileSize &&
+           frame.size == frameLayout(frame.count).size) {
+        TrajectoryIndexEntry entry = {};
+        entry.offset = offset;
+        entry.size = frame.size;
+        entry.step = frame.step;
+        entry.time = frame.time;
+        entry.count = frame.count;
+        index.push_back(entry);
+        offset = alignUp(offset + frame.size, header.pageSize);
+    }
+    return !index.empty();
+}
+
+TrajectoryReader::Frame TrajectoryReader::map(int frame) const {
+    Frame result;
+    if (fd < 0 || frame < 0 || frame >= (int)index.size()) return result;
+
+    // Frames start on the writer's pages, which may be smaller than this
+    // machine's, so map from the page the frame starts in
+    const TrajectoryIndexEntry &entry = index[frame];
+    static const uint64_t systemPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t skip = entry.offset % systemPageSize;
+    size_t length = (size_t)(skip + entry.size);
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, (off_t)(entry.offset - skip));
+    if (mapping == MAP_FAILED) return result;
+
+    const char *base = (const char *)mapping + skip;
+    const TrajectoryFrameHeader *header = (const TrajectoryFrameHeader *)base;
+    // The array offsets are only trusted if they are the ones the writer
+    // lays out, all inside the mapping
+    TrajectoryFrameHeader layout = frameLayout(header->count);
+    if (memcmp(header->magic, frameMagic, sizeof(frameMagic)) != 0 || header->count != entry.count ||
+        header->size != entry.size || header->size != layout.size || header->positions != layout.positions ||
+        header->velocities != layout.velocities || header->densities != layout.densities ||
+        header->radii != layout.radii || header->ids != layout.ids) {
+        munmap(mapping, length);
+        return result;
+    }
+    result.mapping = mapping;
+    result.length = length;
+    result.frame.count = header->count;
+    result.frame.step = header->step;
+    result.frame.time = header->time;
+    result.frame.targetDensity = header->targetDensity;
+    result.frame.positions = (const vec2 *)(base + header->positions);
+    result.frame.velocities = (const vec2 *)(base + header->velocities);
+    result.frame.densities = (const float *)(base + header->densities);
+    result.frame.radii = (const float *)(base + header->radii);
+    result.frame.ids = (const int32_t *)(base + header->ids);
+    return result;
+}
+
+#else
+
+void TrajectoryReader::Frame::release() {
+    mapping = nullptr;
+    length = 0;
+}
+
+void TrajectoryReader::close() {
+    index.clear();
+}
+
+bool TrajectoryReader::open(const string &file) {
+    cerr << "Reading " << file << " needs mmap, which this platform lacks" << endl;
+    return false;
+}
+
+TrajectoryReader::Frame TrajectoryReader::map(int frame) const {
+    return Frame();
+}
+
+#endif
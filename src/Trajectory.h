@@ -0,0 +1,220 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+class Simulation;
+
+// Trajectory files hold snapshots of the drops, one frame per output
+// interval, in the machine's byte order:
+//
+//   header        TrajectoryHeader, padded to the page size
+//   frames        TrajectoryFrameHeader, then the frame's count positions
+//                 and velocities (two floats each), densities and radii
+//                 (float) and stable ids (int32), each array starting on 16
+//                 bytes.
+//                 Every frame starts on a pageSize boundary, so it can be
+//                 mapped alone; machines with larger pages map it from the
+//                 page it falls in.
+//   index         frameCount TrajectoryIndexEntry
+//   footer        TrajectoryFooter, the last bytes of the file
+//
+// A file cut short by a crash has no index, and readers rebuild it by
+// walking the frame headers.
+namespace trajectory {
+
+const uint32_t version = 2;
+const uint32_t pageSize = 4096;
+
+struct TrajectoryHeader {
+    char magic[8];  // "FLUIDTRJ"
+    uint32_t version;
+    uint32_t pageSize;
+    float width;
+    float height;
+};
+
+struct TrajectoryFrameHeader {
+    char magic[4];  // "FRME"
+    uint32_t count;
+    uint64_t step;
+    double time;
+    // Bytes from the start of this header to the end of the ids
+    uint64_t size;
+    // Offsets of the arrays from the start of this header
+    uint32_t positions;
+    uint32_t velocities;
+    uint32_t densities;
+    uint32_t radii;
+    uint32_t ids;
+    // The simulation's target density, which densities are drawn against
+    float targetDensity;
+};
+
+struct TrajectoryIndexEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t step;
+    double time;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct TrajectoryFooter {
+    uint64_t indexOffset;
+    uint64_t frameCount;
+    char magic[8];  // "FLUIDIDX"
+};
+
+} // namespace trajectory
+
+// Streams snapshots of a simulation to a trajectory file from a background
+// thread. capture() copies the drops into one of two snapshot buffers and
+// returns at once while the other may still be on its way to disk, so the
+// simulation never waits on the file. A capture that finds both buffers
+// busy is dropped and counted rather than blocking.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter() = default;
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+    TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+    // Starts a file for a width x height box, printing why it could not
+    bool open(const std::string &file, float width, float height);
+    bool isOpen() const { return ioThread.joinable(); }
+
+    // Queues a snapshot of sim's drops, their radii and, where current,
+    // densities, along with the target density.
+    // Returns false when it had to drop the frame.
+    bool capture(const Simulation &sim, long long step, double time);
+
+    // Writes the queued frames and the index, and closes the file. Returns
+    // false if any write failed.
+    bool close();
+
+    long long getFramesWritten() const { return framesWritten; }
+    long long getFramesDropped() const { return framesDropped; }
+    long long getBytesWritten() const { return bytesWritten; }
+
+private:
+    struct Snapshot {
+        std::vector<glm::vec2> positions;
+        std::vector<glm::vec2> velocities;
+        std::vector<float> densities;
+        std::vector<float> radii;
+        std::vector<int32_t> ids;
+        uint64_t step = 0;
+        double time = 0;
+        float targetDensity = 0;
+    };
+
+    void ioLoop();
+    void writeFrame(const Snapshot &snapshot);
+    void pad();
+
+    std::ofstream out;
+    std::thread ioThread;
+
+    // Snapshots are free, queued for the I/O thread or being written, and
+    // change hands under lock. queued is in capture order.
+    enum State { Free, Queued, Writing };
+    Snapshot snapshots[2];
+    State states[2] = { Free, Free };
+    std::vector<int> queued;
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable wake;
+
+    // Owned by the I/O thread until close() joins it
+    std::vector<trajectory::TrajectoryIndexEntry> index;
+    uint64_t offset = 0;
+    bool failed = false;
+
+    std::atomic<long long> framesWritten{0};
+    std::atomic<long long> framesDropped{0};
+    std::atomic<long long> bytesWritten{0};
+};
+
+// Reads a trajectory file through its index, mapping each frame on demand
+// so opening and seeking cost the same however long the run was. Not
+// available on Windows, where open() always fails.
+class TrajectoryReader {
+public:
+    // Arrays of one frame, valid while the Frame it came from lives
+    struct FrameView {
+        uint32_t count = 0;
+        uint64_t step = 0;
+        double time = 0;
+        float targetDensity = 0;
+        const glm::vec2 *positions = nullptr;
+        const glm::vec2 *velocities = nullptr;
+        const float *densities = nullptr;
+        const float *radii = nullptr;
+        const int32_t *ids = nullptr;
+    };
+
+    // A mapped frame, unmapped when destroyed
+    class Frame {
+    public:
+        Frame() = default;
+        ~Frame();
+        Frame(Frame &&other);
+        Frame &operator=(Frame &&other);
+        Frame(const Frame &) = delete;
+        Frame &operator=(const Frame &) = delete;
+
+        bool isValid() const { return mapping != nullptr; }
+        const FrameView &view() const { return frame; }
+
+    private:
+        friend class TrajectoryReader;
+        void release();
+
+        void *mapping = nullptr;
+        size_t length = 0;
+        FrameView frame;
+    };
+
+    TrajectoryReader() = default;
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader &) = delete;
+    TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+    // Reads the header and index, rebuilding the index from the frames when
+    // the file was never closed. Prints the problem and returns false when
+    // it is not a trajectory.
+    bool open(const std::string &file);
+    void close();
+
+    float getWidth() const { return header.width; }
+    float getHeight() const { return header.height; }
+    int getFrameCount() const { return (int)index.size(); }
+    const trajectory::TrajectoryIndexEntry &getEntry(int frame) const { return index[frame]; }
+    // Whether the index was rebuilt from an unfinished file
+    bool wasRecovered() const { return recovered; }
+
+    // Maps frame, safe to call from any thread once open() returned.
+    // Returns an invalid Frame if the mapping failed.
+    Frame map(int frame) const;
+
+private:
+    bool rebuildIndex(uint64_t fileSize);
+
+    int fd = -1;
+    trajectory::TrajectoryHeader header = {};
+    std::vector<trajectory::TrajectoryIndexEntry> index;
+    bool recovered = false;
+};
+
+#endif // TRAJECTORY_H
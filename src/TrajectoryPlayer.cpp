@@ -0,0 +1,161 @@
+#include "TrajectoryPlayer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+    close();
+}
+
+bool TrajectoryPlayer::open(const string &file) {
+    close();
+    if (!reader.open(file)) return false;
+    stopping = false;
+    paused = false;
+    frameIndex = 0;
+    clock = reader.getEntry(0).time;
+    prefetcher = thread(&TrajectoryPlayer::prefetchLoop, this);
+    return true;
+}
+
+void TrajectoryPlayer::close() {
+    if (prefetcher.joinable()) {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        prefetcher.join();
+    }
+    for (Slot &slot : slots) {
+        slot.mapped = TrajectoryReader::Frame();
+        slot.frame = -1;
+    }
+    reader.close();
+}
+
+void TrajectoryPlayer::update(float deltaTime) {
+    if (paused || getFrameCount() == 0) return;
+    double end = reader.getEntry(getFrameCount() - 1).time;
+    clock = std::min(clock + deltaTime * speed, end);
+    if (clock >= end) paused = true;
+
+    // Frames are in time order, so walk forward from the current one
+    int frame = frameIndex;
+    while (frame + 1 < getFrameCount() && reader.getEntry(frame + 1).time <= clock) frame++;
+    setFrame(frame);
+}
+
+void TrajectoryPlayer::seek(double time) {
+    if (getFrameCount() == 0) return;
+    int low = 0, high = getFrameCount() - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (reader.getEntry(middle).time <= time) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    clock = std::max(time, reader.getEntry(0).time);
+    clock = std::min(clock, reader.getEntry(getFrameCount() - 1).time);
+    setFrame(low);
+}
+
+void TrajectoryPlayer::stepFrames(int frames) {
+    if (getFrameCount() == 0) return;
+    paused = true;
+    int frame = std::min(std::max(frameIndex + frames, 0), getFrameCount() - 1);
+    clock = reader.getEntry(frame).time;
+    setFrame(frame);
+}
+
+void TrajectoryPlayer::setFrame(int frame) {
+    if (frame == frameIndex) return;
+    {
+        lock_guard<mutex> guard(lock);
+        frameIndex = frame;
+    }
+    wake.notify_one();
+}
+
+bool TrajectoryPlayer::inWindow(int frame) const {
+    return frame >= frameIndex - 1 && frame < frameIndex - 1 + cachedFrames;
+}
+
+bool TrajectoryPlayer::install(int frame, TrajectoryReader::Frame &mapped) {
+    lock_guard<mutex> guard(lock);
+    Slot &slot = slots[frame % cachedFrames];
+    if (slot.frame == frame) return true;
+    if (!inWindow(frame)) return false;
+    // Frames in the window all have slots of their own, so this one holds
+    // a frame no longer wanted. Its mapping goes back to the caller, to be
+    // unmapped outside the lock.
+    swap(slot.mapped, mapped);
+    slot.frame = frame;
+    return true;
+}
+
+const TrajectoryReader::FrameView &TrajectoryPlayer::current() {
+    if (getFrameCount() == 0) return empty;
+    Slot &slot = slots[frameIndex % cachedFrames];
+    {
+        // The prefetcher never replaces the current frame's slot, so once it
+        // holds the frame it can be read without the lock
+        lock_guard<mutex> guard(lock);
+        if (slot.frame == frameIndex) return slot.mapped.view();
+    }
+    TrajectoryReader::Frame mapped = reader.map(frameIndex);
+    if (!mapped.isValid()) return empty;
+    install(frameIndex, mapped);
+    lock_guard<mutex> guard(lock);
+    return slot.frame == frameIndex ? slot.mapped.view() : empty;
+}
+
+void TrajectoryPlayer::prefetchLoop() {
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        // Nearest missing frame in the window, looking ahead first
+        int missing = -1;
+        int first = std::max(frameIndex - 1, 0);
+        int last = std::min(frameIndex - 1 + cachedFrames, getFrameCount());
+        for (int frame = frameIndex; frame < last && missing < 0; frame++) {
+            if (slots[frame % cachedFrames].frame != frame) missing = frame;
+        }
+        if (missing < 0 && first < frameIndex && slots[first % cachedFrames].frame != first) missing = first;
+
+        if (stopping) return;
+        if (missing < 0) {
+            int waitingOn = frameIndex;
+            wake.wait(guard, [&] { return stopping || frameIndex != waitingOn; });
+            continue;
+        }
+
+        int pickedAt = frameIndex;
+        guard.unlock();
+        bool installed = false;
+        {
+            TrajectoryReader::Frame mapped = reader.map(missing);
+            if (mapped.isValid()) {
+                // Touch a byte per page so the reads happen here rather than
+                // when the frame is drawn
+                const TrajectoryReader::FrameView &view = mapped.view();
+                const volatile char *bytes = (const volatile char *)view.positions;
+                size_t length = (const char *)(view.ids + view.count) - (const char *)view.positions;
+                char sum = 0;
+                for (size_t offset = 0; offset < length; offset += trajectory::pageSize) {
+                    sum += bytes[offset];
+                }
+                (void)sum;
+                installed = install(missing, mapped);
+            }
+            // Whatever install() handed back is unmapped here, outside the lock
+        }
+        guard.lock();
+        if (!installed && frameIndex == pickedAt) {
+            // Unreadable, so wait for playback to move rather than spin
+            wake.wait(guard, [&] { return stopping || frameIndex != pickedAt; });
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef TRAJECTORYPLAYER_H
+#define TRAJECTORYPLAYER_H
+
+#include "Trajectory.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays a trajectory file back against a clock, for reviewing a run
+// without simulating it. A background thread maps the frames just ahead
+// of the current one and faults their pages in, so advancing rarely
+// touches the disk on the drawing thread.
+class TrajectoryPlayer {
+public:
+    TrajectoryPlayer() = default;
+    ~TrajectoryPlayer();
+
+    TrajectoryPlayer(const TrajectoryPlayer &) = delete;
+    TrajectoryPlayer &operator=(const TrajectoryPlayer &) = delete;
+
+    // Opens the file and starts prefetching from its first frame
+    bool open(const std::string &file);
+    void close();
+
+    float getWidth() const { return reader.getWidth(); }
+    float getHeight() const { return reader.getHeight(); }
+    int getFrameCount() const { return reader.getFrameCount(); }
+
+    // Advances the clock by deltaTime seconds of wall time times the speed,
+    // unless paused. Playback pauses on the last frame.
+    void update(float deltaTime);
+
+    bool isPaused() const { return paused; }
+    void setPaused(bool pause) { paused = pause; }
+    // Recorded seconds per second of wall time
+    float getSpeed() const { return speed; }
+    void setSpeed(float newSpeed) { speed = newSpeed; }
+
+    // Moves to the last frame at or before time, clamped to the recording
+    void seek(double time);
+    // Pauses and moves frames forward, or back when negative
+    void stepFrames(int frames);
+
+    int getFrameIndex() const { return frameIndex; }
+    double getTime() const { return clock; }
+
+    // The current frame, mapped here if the prefetcher has not got to it.
+    // Valid until the next call that moves playback. Empty if unreadable.
+    const TrajectoryReader::FrameView &current();
+
+private:
+    // Frames kept mapped: one behind the current for stepping back, the
+    // current one and the rest ahead
+    static const int cachedFrames = 16;
+
+    struct Slot {
+        int frame = -1;
+        TrajectoryReader::Frame mapped;
+    };
+
+    void setFrame(int frame);
+    // Puts mapped in its slot if frame is in the window, and returns whether
+    // the slot now holds frame
+    bool install(int frame, TrajectoryReader::Frame &mapped);
+    bool inWindow(int frame) const;
+    void prefetchLoop();
+
+    TrajectoryReader reader;
+    double clock = 0;
+    float speed = 1;
+    bool paused = false;
+
+    // Current frame, read by the prefetcher under lock
+    int frameIndex = 0;
+    Slot slots[cachedFrames];
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread prefetcher;
+
+    TrajectoryReader::FrameView empty;
+};
+
+#endif // TRAJECTORYPLAYER_H
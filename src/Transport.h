@@ -0,0 +1,27 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>
+#include <vector>
+
+// Message passing between the processes of a distributed run. Ranks are
+// numbered 0 to size() - 1. Calls return false once the link to a peer is
+// broken, after which the run should be abandoned.
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // Sends size bytes to peer while receiving the peer's message into in.
+    // Both ranks must make the matching call, and neither blocks the other
+    // no matter how large the messages are. in only reallocates when the
+    // message outgrows it.
+    virtual bool exchange(int peer, const char *data, size_t size, std::vector<char> &in) = 0;
+
+    virtual bool send(int peer, const char *data, size_t size) = 0;
+    virtual bool receive(int peer, std::vector<char> &message) = 0;
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,50 @@
+#include "UniformBuffer.h"
+#include "GLSL.h"
+
+#include <cassert>
+#include <cstring>
+
+UniformBuffer::~UniformBuffer()
+{
+	if (bid)
+	{
+		glDeleteBuffers(1, &bid);
+	}
+}
+
+void UniformBuffer::init(GLuint binding, size_t size)
+{
+	this->binding = binding;
+	contents.assign(size, 0);
+	uploaded = false;
+
+	glGenBuffers(1, &bid);
+	glBindBuffer(GL_UNIFORM_BUFFER, bid);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	CHECKED_GL_CALL(glBindBufferBase(GL_UNIFORM_BUFFER, binding, bid));
+}
+
+void UniformBuffer::update(size_t offset, size_t size, const void *data)
+{
+	assert(offset + size <= contents.size());
+	if (uploaded && memcmp(&contents[offset], data, size) == 0)
+	{
+		return;
+	}
+	memcpy(&contents[offset], data, size);
+
+	// Before the first upload the whole buffer goes, so later partial
+	// updates never leave parts of it undefined
+	glBindBuffer(GL_UNIFORM_BUFFER, bid);
+	if (uploaded)
+	{
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	}
+	else
+	{
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, contents.size(), contents.data());
+		uploaded = true;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
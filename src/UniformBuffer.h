@@ -0,0 +1,32 @@
+#pragma once
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <glad/glad.h>
+#include <vector>
+
+// A uniform buffer object bound to a fixed binding point, for uniforms that
+// every program shares such as the camera matrices. Keeps a copy of what it
+// uploaded and skips updates that would not change it.
+class UniformBuffer
+{
+public:
+	UniformBuffer() {}
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator= (const UniformBuffer&) = delete;
+
+	void init(GLuint binding, size_t size);
+	void update(size_t offset, size_t size, const void *data);
+
+	GLuint getBinding() const { return binding; }
+
+private:
+	GLuint bid = 0;
+	GLuint binding = 0;
+	std::vector<unsigned char> contents;
+	bool uploaded = false;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+UniformGrid::UniformGrid(float width, float height) : width(width), height(height) {}
+
+void UniformGrid::setBounds(float width, float height) {
+    layoutChanged = layoutChanged || width != this->width || height != this->height;
+    this->width = width;
+    this->height = height;
+}
+
+int UniformGrid::getGridWidth() const {
+    return (int)ceil(width / cellSize);
+}
+
+int UniformGrid::getGridHeight() const {
+    return (int)ceil(height / cellSize);
+}
+
+int UniformGrid::bucketOf(float x, float y) const {
+    int xCell = (int)floor((x + width / 2) / cellSize);
+    int yCell = (int)floor((y + height / 2) / cellSize);
+
+    // Ensure xCell and yCell are within bounds
+    xCell = std::max(0, std::min(gridWidth - 1, xCell));
+    yCell = std::max(0, std::min(gridHeight - 1, yCell));
+
+    return gridWidth * yCell + xCell;
+}
+
+int UniformGrid::neighborBuckets(float x, float y, int out[9]) const {
+    int cellIdx = bucketOf(x, y);
+    int xCell = cellIdx % gridWidth;
+    int yCell = cellIdx / gridWidth;
+
+    int count = 0;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int neighborX = xCell + dx;
+            int neighborY = yCell + dy;
+
+            // Ensure the neighboring cell is within bounds
+            if (neighborX >= 0 && neighborX < gridWidth && neighborY >= 0 && neighborY < gridHeight) {
+                out[count++] = gridWidth * neighborY + neighborX;
+            }
+        }
+    }
+    return count;
+}
+
+int UniformGrid::bucketsFor(int) {
+    gridWidth = getGridWidth();
+    gridHeight = getGridHeight();
+    return gridWidth * gridHeight;
+}
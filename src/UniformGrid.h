@@ -0,0 +1,34 @@
+#ifndef UNIFORMGRID_H
+#define UNIFORMGRID_H
+
+#include "SpatialGrid.h"
+
+// Dense grid covering the bounding box. Particles outside the box are clamped
+// into the edge cells, so memory grows with the box area.
+class UniformGrid : public SpatialGrid {
+public:
+    UniformGrid(float width = 0.0f, float height = 0.0f);
+
+    const char *name() const override { return "uniform"; }
+
+    void setBounds(float width, float height);
+
+    int bucketOf(float x, float y) const override;
+    int neighborBuckets(float x, float y, int out[9]) const override;
+
+    int getGridWidth() const;
+    int getGridHeight() const;
+
+protected:
+    int bucketsFor(int numParticles) override;
+
+private:
+    float width;
+    float height;
+
+    // Grid dimensions cached by bucketsFor() for the binning loops
+    int gridWidth = 1;
+    int gridHeight = 1;
+};
+
+#endif // UNIFORMGRID_H
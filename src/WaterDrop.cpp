@@ -3,7 +3,7 @@
 #include <iostream>
 
 
-WaterDrop::WaterDrop(float x, float y, float z, float radius) : position(x, y, z), radius(radius) {
+WaterDrop::WaterDrop(float x, float y, float z, float radius) : radius(radius), position(x, y, z) {
     velocity = glm::vec3(0, 0, 0);
 }
 
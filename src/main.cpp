@@ -6,10 +6,30 @@
 
 #include "GLSL.h"
 #include "Program.h"
+#include "UniformBuffer.h"
 #include "Shape.h"
+#include "Texture.h"
 #include "MatrixStack.h"
 #include "WindowManager.h"
-#include "WaterDrop.h"
+#include "OffscreenContext.h"
+#include "Simulation.h"
+#include "UniformGrid.h"
+#include "SpatialHashGrid.h"
+#include "GridBenchmark.h"
+#include "DistributedSimulation.h"
+#include "ParameterSweep.h"
+#include "Scenario.h"
+#include "AllocationCheck.h"
+#include "PhaseProfile.h"
+#include "PerfCheck.h"
+#include "ScalingStudy.h"
+#include "SurfaceBenchmark.h"
+#include "SurfaceExtractor.h"
+#include "FieldRasterizer.h"
+#include "FieldExport.h"
+#include "Trajectory.h"
+#include "TrajectoryPlayer.h"
+#include "Tracer.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader/tiny_obj_loader.h>
@@ -26,81 +46,39 @@ using namespace glm;
 std::chrono::high_resolution_clock::time_point lastFrameTime;
 
 bool playing = false;
-vector<float> densities;
-
-int bbWidth = 18;
-int bbHeight = 12;
-
-vec3 gravity = vec3(0, 0.0, 0);
 
 int numWaterDrops;
-vector<WaterDrop> water;
-float collisionDamping = 0.5;
-
-float targetDensity = 4.0f;
-float pressureMultiplier = 8;
-
-float kernelRadius = 0.9f;
-float viscosityStrength = -0.5f;
-
-vector<vec3> predictedPositions;
-
-vector<int> cells;
-
-void setup() {
-	water.clear();
-	if (numWaterDrops == 1) {
-		water.push_back(WaterDrop(0, 0, 0, 1));
-	} else {
-		float sqrtDrops = sqrt(numWaterDrops);
-		float squareSize = ceil(sqrtDrops);
-	
-		for (int i = 0; i < squareSize; i++) {
-			for (int j = 0; j < squareSize; j++) {
-				float radius = 1 / sqrtDrops;
-				float x = (2 - 2 / sqrtDrops) * ((i / (squareSize - 1)) - 0.5);
-				float y = -(2 - 2 / sqrtDrops) * ((j / (squareSize - 1)) - 0.5);
-	
-				if (j * squareSize + i < numWaterDrops) {
-					water.push_back(WaterDrop(x, y, 0, radius));
-				} 
-			}
-		}
+Simulation sim;
+
+// Where the trace goes when W stops it or the program exits
+string traceFile = "trace.json";
+
+// --record file [interval] saves every interval-th step the window
+// simulates, for --replay
+TrajectoryWriter recording;
+int recordInterval = 1;
+long long recordedSteps = 0;
+double recordedTime = 0;
+
+void finishRecording() {
+	if (recording.isOpen()) {
+		recording.close();
+		cout << "Recorded " << recording.getFramesWritten() << " frames (" << recording.getFramesDropped()
+			<< " dropped), " << recording.getBytesWritten() / 1048576.0 << " MB" << endl;
 	}
 }
 
-void setupRandom() {
-	water.clear();
-	random_device rd;
-  	mt19937 gen(rd());
-
-	std::uniform_real_distribution<float> x_distrib(-bbWidth / 2, bbWidth / 2);
-	std::uniform_real_distribution<float> y_distrib(-bbHeight / 2, bbHeight / 2);
-
-	for (int i = 0; i < numWaterDrops; i++) {
-		float x = x_distrib(gen);
-		float y = y_distrib(gen);
+// --replay file draws a recording instead of simulating
+TrajectoryPlayer replay;
+bool replaying = false;
 
-		// float scale = 10 / (float)numWaterDrops;
-		// float scale = 0.04; // 1 / 25
-		float scale = 0.1;
-
-		water.push_back(WaterDrop(x, y, 0, scale));
+void writeTraceAtExit() {
+	if (isTracing()) {
+		stopTracing();
+		writeTrace(traceFile);
 	}
 }
 
-glm::vec3 randomDirection() {
-    glm::vec3 dir;
-    do {
-        dir = glm::vec3(
-            glm::linearRand(-1.0f, 1.0f),
-            glm::linearRand(-1.0f, 1.0f),
-            0
-        );
-    } while (glm::length(dir) == 0.0f); // Avoid zero vector
-    return glm::normalize(dir);
-}
-
 class Application : public EventCallbacks {
 
 public:
@@ -108,9 +86,50 @@ public:
 	WindowManager * windowManager = nullptr;
 
 	std::shared_ptr<Program> prog;
+	Program::Uniform modelUniform, densityUniform;
+	Program::Attribute positionAttribute, normalAttribute;
+
+	// Uniform buffer binding point of the Camera block
+	static const GLuint cameraBinding = 0;
+	UniformBuffer camera;
+
+	GLuint boxVAO = 0;
+	GLuint boxBuffers[3] = {0, 0, 0};
+	float boxWidth = 0, boxHeight = 0;
+
+	GLuint circleVAO = 0;
+	GLuint circleBuffers[3] = {0, 0, 0};
+	int circleSegments = 0;
+	GLsizei circleIndexCount = 0;
+
+	// Fluid surface drawn as contour lines instead of the drops
+	bool showSurface = false;
+	SurfaceExtractor surface;
+	GLuint surfaceVAO = 0;
+	GLuint surfaceBuffer = 0;
+	GLsizeiptr surfaceCapacity = 0;
+	GLsizei surfaceVertexCount = 0;
+	int surfaceRevision = -1;
+
+	// Rasterized field drawn under the drops, the FieldRasterizer channel
+	// or -1 for none
+	int fieldChannel = -1;
+	FieldRasterizer field;
+	std::shared_ptr<Program> fieldProg;
+	Program::Uniform fieldModelUniform, fieldSamplerUniform, fieldOffsetUniform, fieldScaleUniform;
+	Texture fieldTexture;
+	// Channel value and weight per node, as uploaded
+	vector<float> fieldTexels;
+	GLuint quadVAO = 0;
+	GLuint quadBuffer = 0;
 
 	shared_ptr<Shape> drop;
 
+	// Matrix stacks, kept across frames so drawing does not allocate
+	shared_ptr<MatrixStack> Projection = make_shared<MatrixStack>();
+	shared_ptr<MatrixStack> View = make_shared<MatrixStack>();
+	shared_ptr<MatrixStack> Model = make_shared<MatrixStack>();
+
 	void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
 		if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		{
@@ -122,22 +141,42 @@ public:
 		if (key == GLFW_KEY_Z && action == GLFW_RELEASE) {
 			glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 		}
+		if (replaying && replayKey(key, action, mods)) {
+			return;
+		}
 		if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
 			playing = !playing;
 		}
+		// Drops come and go through the pool without resetting the rest
 		if (key == GLFW_KEY_UP && action != GLFW_RELEASE) {
-			playing = false;
-			numWaterDrops += 1;
-			predictedPositions.clear();
-			predictedPositions.resize(numWaterDrops);
-			densities.clear();
-			densities.resize(numWaterDrops);
-			setup();
-		}
-		if (key == GLFW_KEY_DOWN && action != GLFW_RELEASE) {
-			playing = false;
-			numWaterDrops -= 1;
-			setup();
+			if (sim.addDrop(WaterDrop(linearRand(-1.0f, 1.0f), sim.height / 2 - 1, 0, 0.1)) >= 0) {
+				numWaterDrops = sim.water.size();
+			}
+		}
+		if (key == GLFW_KEY_DOWN && action != GLFW_RELEASE && !sim.water.empty()) {
+			sim.removeDrop(rand() % sim.water.size());
+			numWaterDrops = sim.water.size();
+		}
+		if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+			if (sim.emitters.empty()) {
+				Emitter emitter;
+				emitter.position = vec2(-sim.width / 4, sim.height / 2 - 1);
+				emitter.velocity = vec2(2, 0);
+				emitter.spread = 0.2f;
+				sim.emitters.push_back(emitter);
+			} else {
+				sim.emitters.clear();
+			}
+		}
+		if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+			if (sim.sinks.empty()) {
+				Sink sink;
+				sink.min = vec2(sim.width / 2 - 2, -sim.height / 2);
+				sink.max = vec2(sim.width / 2, -sim.height / 2 + 2);
+				sim.sinks.push_back(sink);
+			} else {
+				sim.sinks.clear();
+			}
 		}
 		if (key == GLFW_KEY_S && action == GLFW_PRESS) {
 			playing = true;
@@ -145,46 +184,137 @@ public:
 			playing = false;
 		}
 		if (key == GLFW_KEY_R && action == GLFW_PRESS) {
-			setup();
+			sim.setup(numWaterDrops);
 			playing = false;
 		}
 		if (key == GLFW_KEY_T && action == GLFW_PRESS) {
-			setupRandom();
+			sim.setupRandom(numWaterDrops);
 			playing = false;
 		}
 		if (key == GLFW_KEY_P && action == GLFW_PRESS) {
-			kernelRadius += 0.1;
+			sim.kernelRadius += 0.1;
 		}
 		if (key == GLFW_KEY_L && action == GLFW_PRESS) {
-			kernelRadius -= 0.1;
-			kernelRadius = std::max(kernelRadius, 0.1f);
+			sim.kernelRadius -= 0.1;
+			sim.kernelRadius = std::max(sim.kernelRadius, 0.1f);
 		}
 		if (key == GLFW_KEY_O && action == GLFW_PRESS) {
-			targetDensity += 1.0f;
+			sim.targetDensity += 1.0f;
 		}
 		if (key == GLFW_KEY_K && action == GLFW_PRESS) {
-			targetDensity -= 1.0f;
+			sim.targetDensity -= 1.0f;
 		}
 		if (key == GLFW_KEY_I && action == GLFW_PRESS) {
-			pressureMultiplier += 1.0f;
+			sim.pressureMultiplier += 1.0f;
 		}
 		if (key == GLFW_KEY_J && action == GLFW_PRESS) {
-			pressureMultiplier -= 1.0f;
+			sim.pressureMultiplier -= 1.0f;
 		}
 		if (key == GLFW_KEY_U && action == GLFW_PRESS) {
-			gravity += vec3(0, 1, 0);
+			sim.gravity += vec3(0, 1, 0);
 		}
 		if (key == GLFW_KEY_H && action == GLFW_PRESS) {
-			gravity -= vec3(0, 1, 0);
+			sim.gravity -= vec3(0, 1, 0);
 		}
 		if (key == GLFW_KEY_Y && action == GLFW_PRESS) {
-			viscosityStrength += 0.1;
+			sim.viscosityStrength += 0.1;
 		}
 		if (key == GLFW_KEY_G && action == GLFW_PRESS) {
-			viscosityStrength -= 0.1;
+			sim.viscosityStrength -= 0.1;
+		}
+		if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+			if (dynamic_cast<SpatialHashGrid *>(sim.grid.get())) {
+				sim.grid = make_shared<UniformGrid>();
+			} else {
+				sim.grid = make_shared<SpatialHashGrid>();
+			}
+		}
+		if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+			sim.incrementalGrid = !sim.incrementalGrid;
+		}
+		if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+			if (sim.obstacles.empty()) {
+				sim.obstacles.addCircle(vec2(0, -sim.height / 4), 1.5f);
+				sim.obstacles.addCapsule(vec2(-sim.width / 3, sim.height / 8), vec2(-1, 0), 0.3f);
+			} else {
+				sim.obstacles.clear();
+			}
+		}
+		if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+			sim.neighborLists = !sim.neighborLists;
+		}
+		if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+			sim.legacyBoundaries = !sim.legacyBoundaries;
+		}
+		if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS) {
+			sim.setThreadCount(sim.scheduler->getThreadCount() - 1);
+		}
+		if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS) {
+			sim.setThreadCount(sim.scheduler->getThreadCount() + 1);
+		}
+		if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+			if (isTracing()) {
+				stopTracing();
+				writeTrace(traceFile);
+			} else {
+				startTracing();
+			}
+		}
+		if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+			showSurface = !showSurface;
+		}
+		// Off, then each rasterized channel but the weight
+		if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
+			fieldChannel = fieldChannel < 0 ? FieldRasterizer::Density : fieldChannel + 1;
+			if (fieldChannel == FieldRasterizer::NumChannels) {
+				fieldChannel = -1;
+			} else {
+				cout << "Field: " << FieldRasterizer::channelName(fieldChannel) << endl;
+			}
+		}
+		if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+			string error;
+			if (sim.counters) {
+				sim.counters.reset();
+			} else if (!sim.openCounters(error)) {
+				cerr << "No hardware counters: " << error << endl;
+			}
 		}
 	}
 
+	// Playback controls while replaying, returning whether key was one
+	bool replayKey(int key, int action, int mods) {
+		if (action == GLFW_RELEASE) {
+			return false;
+		}
+		bool shift = (mods & GLFW_MOD_SHIFT) != 0;
+		if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+			replay.setPaused(!replay.isPaused());
+		} else if (key == GLFW_KEY_RIGHT) {
+			// Shift seeks by seconds, otherwise steps a frame
+			if (shift) {
+				replay.seek(replay.getTime() + 5);
+			} else {
+				replay.stepFrames(1);
+			}
+		} else if (key == GLFW_KEY_LEFT) {
+			if (shift) {
+				replay.seek(replay.getTime() - 5);
+			} else {
+				replay.stepFrames(-1);
+			}
+		} else if (key == GLFW_KEY_UP && action == GLFW_PRESS) {
+			replay.setSpeed(replay.getSpeed() * 2);
+		} else if (key == GLFW_KEY_DOWN && action == GLFW_PRESS) {
+			replay.setSpeed(replay.getSpeed() / 2);
+		} else if (key == GLFW_KEY_HOME && action == GLFW_PRESS) {
+			replay.seek(0);
+		} else {
+			return false;
+		}
+		return true;
+	}
+
 	void mouseCallback(GLFWwindow *window, int button, int action, int mods) {
 		double posX, posY;
 
@@ -211,12 +341,24 @@ public:
 		prog->setVerbose(true);
 		prog->setShaderNames(resourceDirectory + "/simple_vert.glsl", resourceDirectory + "/simple_frag.glsl");
 		prog->init();
-		prog->addUniform("P");
-		prog->addUniform("V");
-		prog->addUniform("M");
-		prog->addUniform("densityDifference");
-		prog->addAttribute("vertPos");
-		prog->addAttribute("vertNor");
+		prog->addUniformBlock("Camera", cameraBinding);
+		modelUniform = prog->addUniform("M");
+		densityUniform = prog->addUniform("densityDifference");
+		positionAttribute = prog->addAttribute("vertPos");
+		normalAttribute = prog->addAttribute("vertNor");
+
+		fieldProg = make_shared<Program>();
+		fieldProg->setVerbose(true);
+		fieldProg->setShaderNames(resourceDirectory + "/field_vert.glsl", resourceDirectory + "/field_frag.glsl");
+		fieldProg->init();
+		fieldProg->addUniformBlock("Camera", cameraBinding);
+		fieldModelUniform = fieldProg->addUniform("M");
+		fieldSamplerUniform = fieldProg->addUniform("field");
+		fieldOffsetUniform = fieldProg->addUniform("fieldOffset");
+		fieldScaleUniform = fieldProg->addUniform("fieldScale");
+
+		// P and V, shared by every program through a uniform buffer
+		camera.init(cameraBinding, 2 * sizeof(glm::mat4));
 	}
 
 	void resize_obj(std::vector<tinyobj::shape_t> &shapes){
@@ -300,318 +442,251 @@ public:
 	}
 
 	/* helper for sending top of the matrix strack to GPU */
-	void setModel(std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack>M) {
-		glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(M->topMatrix()));
+	void setModel(const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
+		prog->setUniform(modelUniform, M->topMatrix());
     }
 
-	void drawRectangle(float width, float height, std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M) {
+	void drawRectangle(float width, float height, const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
 		// Save the current matrix state
 		M->pushMatrix();
-		
-		// Create vertices for the rectangle centered at origin
-		GLfloat vertices[] = {
-			-width/2, -height/2, 0.0f,  // Bottom-left  (0)
-			 width/2, -height/2, 0.0f,  // Bottom-right (1)
-			 width/2,  height/2, 0.0f,  // Top-right    (2)
-			-width/2,  height/2, 0.0f   // Top-left     (3)
-		};
-		
-		// Simple normal (all pointing in z-direction)
-		GLfloat normals[] = {
-			0.0f, 0.0f, 1.0f,
-			0.0f, 0.0f, 1.0f,
-			0.0f, 0.0f, 1.0f,
-			0.0f, 0.0f, 1.0f
-		};
-		
-		// Indices for drawing lines (edges only)
-		GLuint indices[] = {
-			0, 1,  // Bottom edge
-			1, 2,  // Right edge
-			2, 3,  // Top edge
-			3, 0   // Left edge
-		};
-		
-		// Create and bind vertex array object
-		GLuint VAO, VBO_pos, VBO_nor, EBO;
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO_pos);
-		glGenBuffers(1, &VBO_nor);
-		glGenBuffers(1, &EBO);
-		
-		glBindVertexArray(VAO);
-		
-		// Set up position attribute
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(prog->getAttribute("vertPos"));
-		glVertexAttribPointer(prog->getAttribute("vertPos"), 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-		
-		// Set up normal attribute
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_nor);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(prog->getAttribute("vertNor"));
-		glVertexAttribPointer(prog->getAttribute("vertNor"), 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-		
-		// Set up element buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-		
+
+		// The buffers are kept between frames, only the corners change
+		if (!boxVAO) {
+			// Simple normal (all pointing in z-direction)
+			GLfloat normals[] = {
+				0.0f, 0.0f, 1.0f,
+				0.0f, 0.0f, 1.0f,
+				0.0f, 0.0f, 1.0f,
+				0.0f, 0.0f, 1.0f
+			};
+
+			// Indices for drawing lines (edges only)
+			GLuint indices[] = {
+				0, 1,  // Bottom edge
+				1, 2,  // Right edge
+				2, 3,  // Top edge
+				3, 0   // Left edge
+			};
+
+			glGenVertexArrays(1, &boxVAO);
+			glGenBuffers(3, boxBuffers);
+			GLSL::bindVertexArray(boxVAO);
+
+			// Set up position attribute, filled in below
+			glBindBuffer(GL_ARRAY_BUFFER, boxBuffers[0]);
+			glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(GLfloat), nullptr, GL_DYNAMIC_DRAW);
+			GLSL::enableVertexAttribArray(positionAttribute.location);
+			GLSL::vertexAttribPointer(positionAttribute.location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+
+			// Set up normal attribute
+			glBindBuffer(GL_ARRAY_BUFFER, boxBuffers[1]);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
+			GLSL::enableVertexAttribArray(normalAttribute.location);
+			GLSL::vertexAttribPointer(normalAttribute.location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+
+			// Set up element buffer
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxBuffers[2]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+			boxWidth = boxHeight = 0;
+		}
+
+		if (width != boxWidth || height != boxHeight) {
+			// Create vertices for the rectangle centered at origin
+			GLfloat vertices[] = {
+				-width/2, -height/2, 0.0f,  // Bottom-left  (0)
+				 width/2, -height/2, 0.0f,  // Bottom-right (1)
+				 width/2,  height/2, 0.0f,  // Top-right    (2)
+				-width/2,  height/2, 0.0f   // Top-left     (3)
+			};
+			glBindBuffer(GL_ARRAY_BUFFER, boxBuffers[0]);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			boxWidth = width;
+			boxHeight = height;
+		}
+
 		// Set model matrix for the rectangle
 		setModel(prog, M);
-		
+
 		// Draw the rectangle edges only
-		glBindVertexArray(VAO);
+		GLSL::bindVertexArray(boxVAO);
 		glDrawElements(GL_LINES, 8, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-		
-		// Clean up
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO_pos);
-		glDeleteBuffers(1, &VBO_nor);
-		glDeleteBuffers(1, &EBO);
-		
-		// Restore the matrix state
-		M->popMatrix();
-	}
 
-	void drawCircle(float radius, int segments, std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M) {
-		// Save the current matrix state
-		M->pushMatrix();
-		
-		// Calculate vertices for the circle
-		std::vector<GLfloat> vertices;
-		std::vector<GLuint> indices;
-		
-		// Center of the circle (0, 0, 0)
-		vertices.push_back(0.0f);  // x
-		vertices.push_back(0.0f);  // y
-		vertices.push_back(0.0f);  // z
-		
-		// Create vertices around the circle
-		for (int i = 0; i <= segments; ++i) {
-			float angle = (i * 2.0f * M_PI) / segments;
-			vertices.push_back(radius * cos(angle));  // x
-			vertices.push_back(radius * sin(angle));  // y
-			vertices.push_back(0.0f);  // z
-		}
-		
-		// Create indices to form the lines of the circle
-		for (int i = 1; i < segments; ++i) {
-			indices.push_back(0);  // Center of the circle
-			indices.push_back(i);  // Current vertex on the circle
-		}
-		// Close the circle by connecting the last vertex to the first one
-		indices.push_back(0);
-		indices.push_back(segments);
-	
-		// Simple normal (all pointing in z-direction)
-		std::vector<GLfloat> normals(vertices.size(), 0.0f);
-		for (int i = 0; i < vertices.size() / 3; ++i) {
-			normals[i * 3 + 2] = 1.0f;  // Set z-component of the normal
-		}
-	
-		// Create and bind vertex array object
-		GLuint VAO, VBO_pos, VBO_nor, EBO;
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO_pos);
-		glGenBuffers(1, &VBO_nor);
-		glGenBuffers(1, &EBO);
-		
-		glBindVertexArray(VAO);
-		
-		// Set up position attribute
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(prog->getAttribute("vertPos"));
-		glVertexAttribPointer(prog->getAttribute("vertPos"), 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-		
-		// Set up normal attribute
-		glBindBuffer(GL_ARRAY_BUFFER, VBO_nor);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * normals.size(), normals.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(prog->getAttribute("vertNor"));
-		glVertexAttribPointer(prog->getAttribute("vertNor"), 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-		
-		// Set up element buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
-		
-		// Set model matrix for the circle
-		setModel(prog, M);
-		
-		// Draw the circle (as lines from center to each vertex)
-		glBindVertexArray(VAO);
-		glDrawElements(GL_LINES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-		
-		// Clean up
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO_pos);
-		glDeleteBuffers(1, &VBO_nor);
-		glDeleteBuffers(1, &EBO);
-		
 		// Restore the matrix state
 		M->popMatrix();
 	}
-	
-    void drawWaterDrop(WaterDrop waterDrop, std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack>M) {
-		M->pushMatrix();
-			M->translate(waterDrop.position);
-			M->scale(vec3(waterDrop.radius, waterDrop.radius, waterDrop.radius));
-			setModel(prog, M);
-			drop->draw(prog);
-		M->popMatrix();
-    }
 
-	int calculateCell(float x, float y) {
-		int gridWidth = (int)ceil(bbWidth / kernelRadius);
-		int xCell = (int)floor((x + bbWidth / 2) / kernelRadius);
-		int yCell = (int)floor((y + bbHeight / 2) / kernelRadius);
-		
-		// Ensure xCell and yCell are within bounds
-		xCell = max({0, min({gridWidth - 1, xCell})});
-		int gridHeight = (int)ceil(bbHeight / kernelRadius);
-		yCell = max({0, min({gridHeight - 1, yCell})});
-		
-		return gridWidth * yCell + xCell;
-	}
-	
-	vector<int> getNeighborCells(int cellIdx) {
-		vector<int> neighbors;
-	
-		// Compute grid dimensions properly
-		int gridWidth = (int)ceil(bbWidth / kernelRadius);
-		int gridHeight = (int)ceil(bbHeight / kernelRadius);
-	
-		int xCell = cellIdx % gridWidth;  // Get x coordinate in the grid
-		int yCell = cellIdx / gridWidth;  // Get y coordinate in the grid
-	
-		// Check neighboring cells in a 3x3 region
-		for (int dy = -1; dy <= 1; ++dy) {
-			for (int dx = -1; dx <= 1; ++dx) {
-				int neighborX = xCell + dx;
-				int neighborY = yCell + dy;
-	
-				// Ensure the neighboring cell is within bounds
-				if (neighborX >= 0 && neighborX < gridWidth && neighborY >= 0 && neighborY < gridHeight) {
-					int neighborCellIdx = gridWidth * neighborY + neighborX;
-					neighbors.push_back(neighborCellIdx);
-				}
-			}
-		}
-	
-		return neighbors;
-	}
-	
-	float densityToPressure(float density) {
-		if (density < 0.0f) {
-			return 0.0f;  // Return zero pressure for negative densities
-		}
-	
-		float densityDifference = density - targetDensity;
-		float pressure = densityDifference * pressureMultiplier;
-		return pressure;
-	} 
-
-	float calculateSharedPressure(float density1, float density2) {
-		return (densityToPressure(density1) + densityToPressure(density2)) / 2.0;
-	}
-
-	vec3 calculatePressureForce(int samplePointIndex, const vector<vector<int>>& particlesInCell) {
-		vec3 pressureForce = vec3(0.0f, 0.0f, 0.0f);
+	void drawCircle(float radius, int segments, const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
+		// A unit circle, built once per segment count and scaled to radius
+		if (!circleVAO || segments != circleSegments) {
+			// Calculate vertices for the circle
+			std::vector<GLfloat> vertices;
+			std::vector<GLuint> indices;
 
-		float x = water[samplePointIndex].position.x;
-		float y = water[samplePointIndex].position.y;
+			// Center of the circle (0, 0, 0)
+			vertices.push_back(0.0f);  // x
+			vertices.push_back(0.0f);  // y
+			vertices.push_back(0.0f);  // z
 
-		int cell = calculateCell(x, y);
+			// Create vertices around the circle
+			for (int i = 0; i <= segments; ++i) {
+				float angle = (i * 2.0f * M_PI) / segments;
+				vertices.push_back(cos(angle));  // x
+				vertices.push_back(sin(angle));  // y
+				vertices.push_back(0.0f);  // z
+			}
 
-		for (int cellIdx : getNeighborCells(cell)) {
-			for (int i : particlesInCell[cellIdx]) {
-				if (i == samplePointIndex) continue;
+			// Create indices to form the lines of the circle
+			for (int i = 1; i < segments; ++i) {
+				indices.push_back(0);  // Center of the circle
+				indices.push_back(i);  // Current vertex on the circle
+			}
+			// Close the circle by connecting the last vertex to the first one
+			indices.push_back(0);
+			indices.push_back(segments);
+
+			// Simple normal (all pointing in z-direction)
+			std::vector<GLfloat> normals(vertices.size(), 0.0f);
+			for (size_t i = 0; i < vertices.size() / 3; ++i) {
+				normals[i * 3 + 2] = 1.0f;  // Set z-component of the normal
+			}
 
-				vec3 difference = predictedPositions[i] - water[samplePointIndex].position;
-				float distance = length(difference);
-	
-				vec3 direction;
-				if (distance == 0) {
-					direction = randomDirection(); //should make this random later
-				} else {
-					direction = difference / distance;
-				}
-	
-				float slope = smoothingKernelDerivative(kernelRadius, distance);
-				float density = densities[i];
-				float mass = 1.0;
-				float sharedPressure = calculateSharedPressure(density, densities[samplePointIndex]);
-				pressureForce += sharedPressure * direction * slope * mass / density; 	
+			if (!circleVAO) {
+				glGenVertexArrays(1, &circleVAO);
+				glGenBuffers(3, circleBuffers);
 			}
+			GLSL::bindVertexArray(circleVAO);
+
+			// Set up position attribute
+			glBindBuffer(GL_ARRAY_BUFFER, circleBuffers[0]);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+			GLSL::enableVertexAttribArray(positionAttribute.location);
+			GLSL::vertexAttribPointer(positionAttribute.location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+
+			// Set up normal attribute
+			glBindBuffer(GL_ARRAY_BUFFER, circleBuffers[1]);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * normals.size(), normals.data(), GL_STATIC_DRAW);
+			GLSL::enableVertexAttribArray(normalAttribute.location);
+			GLSL::vertexAttribPointer(normalAttribute.location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+
+			// Set up element buffer
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, circleBuffers[2]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			circleSegments = segments;
+			circleIndexCount = (GLsizei)indices.size();
 		}
-		return pressureForce;
-	}
 
-	float viscositySmoothingKernel(float kernelRadius, float distance) {
-		if (distance >= kernelRadius) return 0;
-
-		float volume = (3.1415 * pow(kernelRadius, 4)) / 6; 
-		return (kernelRadius - distance) * (kernelRadius - distance) / volume;
-	} 
-
-	vec3 calculateViscosity(int i, const vector<vector<int>>& particlesInCell) {
-		vec3 viscosityForce = vec3(0.0f, 0.0f, 0.0f);
-		vec3 position = water[i].position;
+		// Set model matrix for the circle
+		prog->setUniform(modelUniform, M->translatedScaled(vec3(0, 0, 0), radius));
 
-		float x = water[i].position.x;
-		float y = water[i].position.y;
+		// Draw the circle (as lines from center to each vertex)
+		GLSL::bindVertexArray(circleVAO);
+		glDrawElements(GL_LINES, circleIndexCount, GL_UNSIGNED_INT, 0);
+	}
 
-		int cell = calculateCell(x, y);
+	// Contour of the fluid, uploaded only when the extractor changed it
+	void drawSurface(const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
+		surface.extract(sim.water, sim.width, sim.height, *sim.scheduler);
+		if (!surfaceVAO) {
+			glGenVertexArrays(1, &surfaceVAO);
+			glGenBuffers(1, &surfaceBuffer);
+			GLSL::bindVertexArray(surfaceVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, surfaceBuffer);
+			GLSL::enableVertexAttribArray(positionAttribute.location);
+			GLSL::vertexAttribPointer(positionAttribute.location, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
 
-		for (int cellIdx : getNeighborCells(cell)) {
-			for (int particleIdx : particlesInCell[cellIdx]) {
-				float dst = length(water[i].position - water[particleIdx].position);
-				float influence = viscositySmoothingKernel(kernelRadius, dst);
-				viscosityForce += influence * (water[i].velocity - water[particleIdx].velocity);
+		if (surface.getRevision() != surfaceRevision) {
+			const vector<vec2> &segments = surface.getSegments();
+			GLsizeiptr size = segments.size() * 2 * sizeof(GLfloat);
+			glBindBuffer(GL_ARRAY_BUFFER, surfaceBuffer);
+			// Grows by doubling and is otherwise overwritten in place
+			if (size > surfaceCapacity) {
+				surfaceCapacity = std::max(size, 2 * surfaceCapacity);
+				glBufferData(GL_ARRAY_BUFFER, surfaceCapacity, nullptr, GL_DYNAMIC_DRAW);
 			}
+			if (size > 0) {
+				glBufferSubData(GL_ARRAY_BUFFER, 0, size, segments.data());
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			surfaceVertexCount = (GLsizei)segments.size();
+			surfaceRevision = surface.getRevision();
 		}
-		return viscosityForce * viscosityStrength;
-	}
-
-	float smoothingKernel(float kernelRadius, float distance) {
-		if (distance >= kernelRadius) return 0;
 
-		float volume = (3.1415 * pow(kernelRadius, 4)) / 6; 
-		return (kernelRadius - distance) * (kernelRadius - distance) / volume;
-	} 
-
-	float smoothingKernelDerivative(float kernelRadius, float distance) {
-		if (distance >= kernelRadius) return 0;
+		prog->setUniform(densityUniform, 0);
+		setModel(prog, M);
+		GLSL::bindVertexArray(surfaceVAO);
+		glDrawArrays(GL_LINES, 0, surfaceVertexCount);
+	}
 
-		float scale = 12 / (pow(kernelRadius, 4) * 3.1415);
-		return (distance - kernelRadius) * scale;
-	}	
-	
-	float calculateDensity(int i, const vector<vector<int>>& particlesInCell) {
-		float density = 0;
-		float mass = 1;
+	// The selected channel of the rasterized field on a quad over the box,
+	// just behind the drops
+	void drawField(const std::shared_ptr<MatrixStack> &M) {
+		// Coarse enough that neighboring drops share nodes
+		field.cellSize = sim.kernelRadius / 3;
+		field.rasterize(sim);
+		const vector<float> &values = field.getChannel(fieldChannel);
+		const vector<float> &weights = field.getChannel(FieldRasterizer::Weight);
+		fieldTexels.resize(2 * values.size());
+		for (size_t i = 0; i < values.size(); i++) {
+			fieldTexels[2 * i] = values[i];
+			fieldTexels[2 * i + 1] = weights[i];
+		}
+		fieldTexture.setData(field.getGridWidth(), field.getGridHeight(), 2, fieldTexels.data());
+
+		if (!quadVAO) {
+			GLfloat corners[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+			glGenVertexArrays(1, &quadVAO);
+			glGenBuffers(1, &quadBuffer);
+			GLSL::bindVertexArray(quadVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+			GLSL::enableVertexAttribArray(0);
+			GLSL::vertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
 
-		float x = water[i].position.x;
-		float y = water[i].position.y;
+		// Texel centres sit on the nodes, so the quad reaches half a cell
+		// past the first and last
+		vec2 first = field.gridPoint(0, 0) - vec2(field.cellSize / 2);
+		vec2 size = vec2(field.getGridWidth(), field.getGridHeight()) * field.cellSize;
+		M->pushMatrix();
+		M->translate(vec3(first.x, first.y, -0.2f));
+		M->scale(vec3(size.x, size.y, 1));
+
+		fieldProg->bind();
+		fieldProg->setUniform(fieldModelUniform, M->topMatrix());
+		fieldProg->setUniform(fieldOffsetUniform, fieldChannel == FieldRasterizer::Density ? sim.targetDensity : 0.0f);
+		fieldProg->setUniform(fieldScaleUniform, 1.0f);
+		fieldTexture.bind(fieldSamplerUniform.location);
+		GLSL::bindVertexArray(quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		fieldTexture.unbind();
+		fieldProg->unbind();
+		M->popMatrix();
+	}
 
-		int cell = calculateCell(x, y);
+	// The drop mesh at position, scaled to radius
+	void drawSphere(const vec3 &position, float radius, const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
+		prog->setUniform(modelUniform, M->translatedScaled(position, radius));
+		drop->draw(prog);
+	}
 
-		for (int cellIdx : getNeighborCells(cell)) {
-			for (int particleIdx : particlesInCell[cellIdx]) {
-				float distance = length(vec2(water[particleIdx].position.x, water[particleIdx].position.y) - vec2(x, y));
-				float influence = smoothingKernel(kernelRadius, distance);
-				density += influence * mass;
-			}
-		}	
-		return density;
-	} 
+    void drawWaterDrop(const WaterDrop &waterDrop, const std::shared_ptr<Program> &prog, const std::shared_ptr<MatrixStack> &M) {
+		drawSphere(waterDrop.position, waterDrop.radius, prog, M);
+    }
 
 	void render(float deltaTime) {
 		// Get current frame buffer size.
 		int width, height;
 		glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+		render(deltaTime, width, height);
+	}
+
+	void render(float deltaTime, int width, int height) {
 		glViewport(0, 0, width, height);
 
 		// Clear framebuffer.
@@ -620,10 +695,8 @@ public:
 		//Use the matrix stack for Lab 6
 		float aspect = width/(float)height;
 
-		// Create the matrix stacks - please leave these alone for now
-		auto Projection = make_shared<MatrixStack>();
-		auto View = make_shared<MatrixStack>();
-		auto Model = make_shared<MatrixStack>();
+		// Model accumulates the camera offset below, so start it over
+		Model->loadIdentity();
 
 		// Apply perspective projection.
 		Projection->pushMatrix();
@@ -635,61 +708,78 @@ public:
 
 		// Draw base Hierarchical person
 		prog->bind();
-		static glm::mat4 lastProjection, lastView;
-		if (Projection->topMatrix() != lastProjection) {
-			glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, value_ptr(Projection->topMatrix()));
-			lastProjection = Projection->topMatrix();
+		{
+			// Only uploaded when they change
+			TraceSpan span("uniforms", "render");
+			camera.update(0, sizeof(glm::mat4), value_ptr(Projection->topMatrix()));
+			camera.update(sizeof(glm::mat4), sizeof(glm::mat4), value_ptr(View->topMatrix()));
 		}
 
-		if (View->topMatrix() != lastView) {
-			glUniformMatrix4fv(prog->getUniform("V"), 1, GL_FALSE, value_ptr(View->topMatrix()));
-			lastView = View->topMatrix();
+		{
+			TraceSpan span("draw box", "render");
+			drawRectangle(sim.width, sim.height, prog, Model);
+
+			// Obstacle outlines, traced from the baked distance grid
+			if (!sim.obstacles.empty() && sim.obstacles.isBaked()) {
+				prog->setUniform(densityUniform, 0);
+				for (int y = 0; y < sim.obstacles.getGridHeight(); y++) {
+					for (int x = 0; x < sim.obstacles.getGridWidth(); x++) {
+						if (fabs(sim.obstacles.gridValue(x, y)) < sim.obstacleResolution / 2) {
+							vec2 point = sim.obstacles.gridPoint(x, y);
+							drawSphere(vec3(point.x, point.y, 0), 0.05f, prog, Model);
+						}
+					}
+				}
+			}
 		}
-
-
-		drawRectangle(bbWidth, bbHeight, prog, Model);
 		// drawCircle(kernelRadius, 100, prog, Model);
 
-		// Predict Future Positions
-		predictedPositions.resize(numWaterDrops);
-		for (int i = 0; i < numWaterDrops; i++) {
-			predictedPositions[i] = water[i].position + water[i].velocity * 1.0f / 120.0f;
-		}
-
-		// Calculate neighbors
-		int numCells = calculateCell(bbWidth, bbHeight) + 1;
-		vector<vector<int>> particlesInCell(numCells);
-		for (int i = 0; i < numWaterDrops; i++) {
-			float x = predictedPositions[i].x;
-			float y = predictedPositions[i].y;
-			int cell = calculateCell(x, y);
-			particlesInCell[cell].push_back(i);
-		}
-
-		// Calculate Densities
-		densities.resize(numWaterDrops);
-		for (int i = 0; i < predictedPositions.size(); i++) {
-			float currentDensity = calculateDensity(i, particlesInCell);
-			densities[i] = currentDensity;
-		}
-
-		// Update Particles
-		for (int i = 0; i < water.size(); i++) {
+		if (replaying) {
+			// Straight from the mapped frame, with no simulation
+			replay.update(deltaTime);
+			const TrajectoryReader::FrameView &frame = replay.current();
+			TraceSpan span("draw replay", "render", "drops", frame.count);
+			for (uint32_t i = 0; i < frame.count; i++) {
+				prog->setUniform(densityUniform, frame.densities[i] - frame.targetDensity);
+				drawSphere(vec3(frame.positions[i].x, frame.positions[i].y, 0), frame.radii[i], prog, Model);
+			}
+		} else {
+			// Densities are needed for colouring even while paused
+			sim.beginStep();
 			if (playing) {
-				vec3 pressure = calculatePressureForce(i, particlesInCell) / densities[i];
-				vec3 viscosity = calculateViscosity(i, particlesInCell);
-				// vec3 viscosity = vec3(0, 0, 0);
-				vec3 acceleration = pressure + viscosity + gravity;
-				water[i].Update(acceleration, deltaTime);
-				water[i].velocity *= 0.99; // Dampening
-				water[i].ResolveOutOfBounds(bbWidth, bbHeight, collisionDamping);
-			}	
-		}
+				sim.updateEmitters(deltaTime);
+				numWaterDrops = sim.water.size();
+			}
+			if (!sim.predictionsCurrent()) {
+				sim.predictPositions();
+			}
+			sim.updateGrid();
+			sim.computeDensities();
+			if (playing) {
+				sim.integrate(deltaTime);
+				recordedTime += deltaTime;
+				if (recording.isOpen() && ++recordedSteps % recordInterval == 0) {
+					recording.capture(sim, recordedSteps, recordedTime);
+				}
+			}
+
+			if (fieldChannel >= 0) {
+				TraceSpan span("draw field", "render");
+				drawField(Model);
+				prog->bind();
+			}
 
-		// Draw Particles
-		for (int i = 0; i < water.size(); i++) {
-			glUniform1f(prog->getUniform("densityDifference"), densities[i] - targetDensity);
-			drawWaterDrop(water[i], prog, Model);
+			// Draw Particles
+			if (showSurface) {
+				TraceSpan span("draw surface", "render", "drops", sim.water.size());
+				drawSurface(prog, Model);
+			} else {
+				TraceSpan span("draw drops", "render", "drops", sim.water.size());
+				for (size_t i = 0; i < sim.water.size(); i++) {
+					prog->setUniform(densityUniform, sim.densities[i] - sim.targetDensity);
+					drawWaterDrop(sim.water[i], prog, Model);
+				}
+			}
 		}
 
 		prog->unbind();
@@ -711,18 +801,165 @@ int main(int argc, char *argv[]) {
 	// Where the resources are loaded from
 	std::string resourceDir = "../resources";
 
+	// --trace file, anywhere on the command line, records a trace of the
+	// whole run for chrome://tracing or Perfetto
+	nameTraceThread("main");
+	atexit(writeTraceAtExit);
+	for (int i = 1; i + 1 < argc; i++) {
+		if (string(argv[i]) == "--trace") {
+			traceFile = argv[i + 1];
+			startTracing();
+			for (int j = i; j + 2 <= argc; j++) {
+				argv[j] = argv[j + 2];
+			}
+			argc -= 2;
+			break;
+		}
+	}
+
+	// --render frames pattern [width height] after the drops or scenario
+	// renders that many frames with no window into files named by the
+	// printf pattern, e.g. frames/%05d.png
+	int renderFrames = 0;
+	string renderPattern;
+	int renderWidth = 1280, renderHeight = 960;
+	for (int i = 1; i + 2 < argc; i++) {
+		if (string(argv[i]) == "--render") {
+			renderFrames = atoi(argv[i + 1]);
+			renderPattern = argv[i + 2];
+			int used = 3;
+			if (i + 4 < argc && atoi(argv[i + 3]) > 0 && atoi(argv[i + 4]) > 0) {
+				renderWidth = atoi(argv[i + 3]);
+				renderHeight = atoi(argv[i + 4]);
+				used = 5;
+			}
+			for (int j = i; j + used <= argc; j++) {
+				argv[j] = argv[j + used];
+			}
+			argc -= used;
+			break;
+		}
+	}
+
+	// --record file [interval] after the drops or scenario
+	string recordFile;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (string(argv[i]) == "--record") {
+			recordFile = argv[i + 1];
+			int used = 2;
+			if (i + 2 < argc && atoi(argv[i + 2]) > 0) {
+				recordInterval = atoi(argv[i + 2]);
+				used = 3;
+			}
+			for (int j = i; j + used <= argc; j++) {
+				argv[j] = argv[j + used];
+			}
+			argc -= used;
+			break;
+		}
+	}
+
 	if (argc < 2) {
-		cout << "Usage: ./fluid-simulation num-water-drops";
+		cout << "Usage: ./fluid-simulation num-water-drops" << endl;
+		cout << "       ./fluid-simulation --bench-grid num-water-drops" << endl;
+		cout << "       ./fluid-simulation --ranks num-processes num-water-drops [steps]" << endl;
+		cout << "       ./fluid-simulation --sweep sweep-file output.csv|output.json" << endl;
+		cout << "       ./fluid-simulation --scenario scenario-file [--headless]" << endl;
+		cout << "       ./fluid-simulation --alloc-check num-water-drops [steps] [budget]" << endl;
+		cout << "       ./fluid-simulation --profile num-water-drops [steps]" << endl;
+		cout << "       ./fluid-simulation --perf-check [baseline.json] [--update]" << endl;
+		cout << "       ./fluid-simulation --scaling [max-threads] [drops-per-thread] [steps] [output.csv]" << endl;
+		cout << "       ./fluid-simulation --surface num-water-drops [steps] [output.obj]" << endl;
+		cout << "       ./fluid-simulation --field num-water-drops [steps] [output.csv]" << endl;
+		cout << "       ./fluid-simulation --replay recording" << endl;
+		cout << "Any of these take --trace trace.json to record a timeline, the first and" << endl;
+		cout << "--scenario take --record recording [interval] to save the run for --replay," << endl;
+		cout << "and those and --replay take --render frames pattern.png [width height] to" << endl;
+		cout << "render without a window";
+		return 0;
+	} else if (string(argv[1]) == "--bench-grid") {
+		runGridBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
 		return 0;
+	} else if (string(argv[1]) == "--ranks" && argc > 3) {
+		return runDistributed(atoi(argv[2]), atoi(argv[3]), argc > 4 ? atoi(argv[4]) : 600);
+	} else if (string(argv[1]) == "--sweep" && argc > 3) {
+		return runSweep(argv[2], argv[3]);
+	} else if (string(argv[1]) == "--scaling") {
+		return runScalingStudy(argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency(), argc > 3 ? atoi(argv[3]) : 2000,
+			argc > 4 ? atoi(argv[4]) : 30, argc > 5 ? argv[5] : "");
+	} else if (string(argv[1]) == "--surface" && argc > 2) {
+		return runSurfaceBenchmark(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 60, argc > 4 ? argv[4] : "");
+	} else if (string(argv[1]) == "--field" && argc > 2) {
+		return runFieldExport(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 60, argc > 4 ? argv[4] : "");
+	} else if (string(argv[1]) == "--perf-check") {
+		bool update = string(argv[argc - 1]) == "--update";
+		string baseline = argc > 2 && string(argv[2]) != "--update" ? argv[2] : "../bench/perf-baseline.json";
+		return runPerfCheck(baseline, update);
+	} else if (string(argv[1]) == "--profile" && argc > 2) {
+		return runPhaseProfile(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 300);
+	} else if (string(argv[1]) == "--alloc-check" && argc > 2) {
+		return runAllocationCheck(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 300, argc > 4 ? atol(argv[4]) : 0);
+	} else if (string(argv[1]) == "--replay" && argc > 2) {
+		if (!replay.open(argv[2])) {
+			return 1;
+		}
+		replaying = true;
+		sim.width = replay.getWidth();
+		sim.height = replay.getHeight();
+		cout << "Replaying " << replay.getFrameCount() << " frames: space pauses, left and right step" << endl;
+		cout << "a frame (with shift, seek 5 s), up and down change the speed, home rewinds" << endl;
+	} else if (string(argv[1]) == "--scenario" && argc > 2) {
+		if (argc > 3 && string(argv[3]) == "--headless") {
+			return runScenario(argv[2], recordFile, recordInterval);
+		}
+		Scenario scenario;
+		if (!scenario.load(argv[2])) {
+			return 1;
+		}
+		scenario.initialize(sim);
+		numWaterDrops = sim.water.size();
 	} else {
 		// Create grid of water drops for start of simulation
 		numWaterDrops = atoi(argv[1]);
-		// setup();
-		setupRandom();
+		// sim.setup(numWaterDrops);
+		sim.setupRandom(numWaterDrops);
+	}
+	// Room for the emitter and UP to add drops without reallocating
+	sim.reserve(numWaterDrops * 2 + 1000);
+
+	if (!recordFile.empty() && !replaying) {
+		if (!recording.open(recordFile, sim.width, sim.height)) {
+			return 1;
+		}
+		atexit(finishRecording);
 	}
 
 	Application *application = new Application();
 
+	if (renderFrames > 0) {
+		OffscreenContext offscreen;
+		if (!offscreen.init(renderWidth, renderHeight)) {
+			return 1;
+		}
+		application->init(resourceDir);
+		application->initGeom(resourceDir);
+
+		playing = true;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < renderFrames; frame++) {
+			application->render(1.0f / 60.0f, offscreen.getWidth(), offscreen.getHeight());
+			char file[1024];
+			snprintf(file, sizeof(file), renderPattern.c_str(), frame);
+			if (!offscreen.saveFrame(file)) {
+				return 1;
+			}
+		}
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		cout << "Rendered " << renderFrames << " frames at " << renderWidth << "x" << renderHeight << ", "
+			<< renderFrames / elapsed.count() << " frames per second" << endl;
+		return 0;
+	}
+
 	// Your main will always include a similar set up to establish your window
 	// and GL context, etc.
 
@@ -738,21 +975,60 @@ int main(int argc, char *argv[]) {
 	application->initGeom(resourceDir);
 
 	lastFrameTime = std::chrono::high_resolution_clock::now();
+	AllocationCount frameStart = allocationCount();
 
 	// Loop until the user closes the window.
 	while (! glfwWindowShouldClose(windowManager->getHandle()))
 	{ 
+		TraceSpan frameSpan("frame", "render");
 
 		// float deltaTime = getDeltaTime();
 		float deltaTime = min({1.0f / 20.0f, getDeltaTime()});
 
 		cout << "=================" << endl;
-		cout << "Target Density: " << targetDensity << endl;
-		cout << "Kernel Radius: " << kernelRadius << endl;
-		cout << "Pressure Multiplier: " << pressureMultiplier << endl;
-		cout << "Gravity: " << gravity.y << endl;
-		cout << "Viscosity Strength: " << viscosityStrength << endl;
-		cout << "FPS: " << 1 / deltaTime << endl;
+		if (replaying) {
+			cout << "Replay: frame " << replay.getFrameIndex() + 1 << " / " << replay.getFrameCount() << ", "
+				<< replay.getTime() << " s, " << replay.getSpeed() << "x" << (replay.isPaused() ? ", paused" : "") << endl;
+			cout << "FPS: " << 1 / deltaTime << endl;
+		} else {
+			cout << "Target Density: " << sim.targetDensity << endl;
+			cout << "Kernel Radius: " << sim.kernelRadius << endl;
+			cout << "Pressure Multiplier: " << sim.pressureMultiplier << endl;
+			cout << "Gravity: " << sim.gravity.y << endl;
+			cout << "Viscosity Strength: " << sim.viscosityStrength << endl;
+			cout << "Grid: " << sim.grid->name() << " (" << sim.grid->memoryUsage() / 1024 << " KB)" << endl;
+			cout << "Step Heap Allocations: " << sim.stepAllocations().allocations
+				<< " (" << sim.stepAllocations().bytes / 1024 << " KB)" << endl;
+			for (int phase = 0; phase < Simulation::NumPhases; phase++) {
+				const Simulation::PhaseStats &stats = sim.getPhaseStats(phase);
+				cout << "Phase " << Simulation::phaseName(phase) << ": " << stats.ms << " ms";
+				if (allocationCountingEnabled()) {
+					cout << ", " << stats.heap.allocations << " allocations (" << stats.heap.bytes << " bytes)";
+				}
+				if (sim.counters) {
+					for (int counter = 0; counter < PerfCount::NumCounters; counter++) {
+						if (sim.counters->has(counter)) {
+							cout << ", " << stats.events.values[counter] << " " << PerfCount::counterName(counter);
+						}
+					}
+				}
+				cout << endl;
+			}
+			if (allocationCountingEnabled()) {
+				AllocationCount frame = allocationCount() - frameStart;
+				frameStart = allocationCount();
+				cout << "Frame Allocations: " << frame.allocations << " (" << frame.bytes / 1024 << " KB)" << endl;
+			}
+			const vector<TaskScheduler::WorkerStats> &workers = sim.scheduler->getStats();
+			for (size_t i = 0; i < workers.size(); i++) {
+				cout << "Thread " << i << ": " << workers[i].busyMs << " ms busy, " << workers[i].tasks
+					<< " tasks, " << workers[i].steals << " stolen" << endl;
+			}
+			cout << "Grid Moved: " << sim.grid->getMovedCount()
+				<< (sim.grid->wasIncremental() ? " (patched)" : " (rebuilt)") << endl;
+			cout << "Drops: " << sim.water.size() << " / " << sim.pool.capacity() << endl;
+			cout << "FPS: " << 1 / deltaTime << endl;
+		}
 
 		
 
@@ -760,7 +1036,10 @@ int main(int argc, char *argv[]) {
 		application->render(deltaTime);
 
 		// Swap front and back buffers.
-		glfwSwapBuffers(windowManager->getHandle());
+		{
+			TraceSpan span("swap", "render");
+			glfwSwapBuffers(windowManager->getHandle());
+		}
 		// Poll for and process events.
 		glfwPollEvents();
 	}